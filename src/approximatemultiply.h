@@ -0,0 +1,206 @@
+#ifndef APPROXIMATEMULTIPLY_H
+#define APPROXIMATEMULTIPLY_H
+
+///
+/// Approximate matrix product by sampling
+/// ======================================
+///
+/// A * B is the sum of the n outer products of the columns of A with the rows of B. Summing only s of them,
+/// picked at random with a probability proportional to |A(:, k)| * |B(k, :)| and weighted by the inverse of
+/// their expected count, gives an unbiased estimate of A * B whose expected squared error is
+///
+///     E |A * B - C|^2 = ((sum_k |A(:, k)| * |B(k, :)|)^2 - |A * B|^2) / s       (Frobenius norms)
+///
+/// The caller gives the relative error wanted, the number of samples is derived from this formula, |A * B|
+/// being estimated with a few random probes. The sampled sub-product costs n * n * s multiply-adds instead of
+/// n * n * n, and its blocks run on a ThreadedMatrixMultiplier.
+///
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+#include "matrix.h"
+#include "threadedmatrixmultiplier.h"
+
+
+///
+/// What an approximate product did
+///
+struct ApproximationReport
+{
+    int nbSamples{0};                 // Outer products summed, duplicates included
+    int nbDistinctSamples{0};         // Columns of A actually read
+    double expectedRelativeError{0};  // Square root of the expected squared error, relative to |A * B|
+    bool isExact{false};              // The sampling would not have been cheaper, A * B was computed
+};
+
+
+///
+/// A sampled product, shared by all its blocks
+///
+template<class T>
+struct SampledProduct
+{
+    const SquareMatrix<T>* A;
+    const SquareMatrix<T>* B;
+    SquareMatrix<T>* C;
+    const int* indices;    // Distinct sampled k
+    const double* weights; // Weight of each of them, not rounded so that integer products stay unbiased
+    int nbIndices;
+    int blockSize;
+};
+
+
+///
+/// \brief Computes the block (blockI, blockJ) of a sampled product
+/// \param context The SampledProduct
+///
+template<class T>
+void computeSampledTile(void* context, int blockI, int blockJ)
+{
+    const SampledProduct<T>& p = *static_cast<const SampledProduct<T>*>(context);
+    int n = p.C->size();
+    int lastRow = std::min(n, (blockI + 1) * p.blockSize);
+    int lastColumn = std::min(n, (blockJ + 1) * p.blockSize);
+    for (int i = blockI * p.blockSize; i < lastRow; ++i) {
+        for (int j = blockJ * p.blockSize; j < lastColumn; ++j) {
+            double sum = 0;
+            for (int s = 0; s < p.nbIndices; ++s) {
+                int k = p.indices[s];
+                sum += p.weights[s] * static_cast<double>(p.A->element(k, i)) * static_cast<double>(p.B->element(j, k));
+            }
+            // Only the estimate is rounded, not the weights
+            if constexpr (std::is_integral_v<T>) {
+                p.C->setElement(j, i, static_cast<T>(std::llround(sum)));
+            }
+            else {
+                p.C->setElement(j, i, static_cast<T>(sum));
+            }
+        }
+    }
+}
+
+
+///
+/// \brief Computes an approximation of C = A * B
+/// \param engine The multiplier whose pool computes the blocks
+/// \param A First matrix
+/// \param B Second matrix
+/// \param C Approximation of AxB
+/// \param targetRelativeError Wanted |C - A * B| / |A * B|, in expectation. 0 computes the exact product.
+/// \param seed Seed of the sampling, the same seed giving the same C
+/// \return The number of samples and the expected error
+///
+/// The sampling pays off for a target error well above 1 / sqrt(n). Below, or when the columns of A and
+/// rows of B have no dominant ones, the number of samples reaches n and the exact product is computed.
+///
+template<class T>
+ApproximationReport multiplyApproximate(ThreadedMatrixMultiplier<T>& engine, const SquareMatrix<T>& A,
+                                        const SquareMatrix<T>& B, SquareMatrix<T>& C, double targetRelativeError,
+                                        uint64_t seed = 0)
+{
+    ApproximationReport report;
+    int n = A.size();
+    if (n == 0) {
+        return report;
+    }
+
+    // Norms of the columns of A and of the rows of B, whose products are the weights of the outer products
+    std::vector<double> columnNorms(n, 0.0);
+    std::vector<double> rowNorms(n, 0.0);
+    for (int i = 0; i < n; ++i) {
+        for (int k = 0; k < n; ++k) {
+            double a = A.element(k, i);
+            double b = B.element(k, i);
+            columnNorms[k] += a * a;
+            rowNorms[i] += b * b;
+        }
+    }
+    std::vector<double> probabilities(n);
+    double normSum = 0;
+    for (int k = 0; k < n; ++k) {
+        probabilities[k] = std::sqrt(columnNorms[k]) * std::sqrt(rowNorms[k]);
+        normSum += probabilities[k];
+    }
+
+    // |A * B|^2 is the expected value of |A * B * g|^2 for a vector g of random signs
+    constexpr int NB_PROBES = 8;
+    std::mt19937_64 random(seed);
+    std::vector<double> g(n);
+    std::vector<double> Bg(n);
+    double productNorm2 = 0;
+    for (int probe = 0; probe < NB_PROBES; ++probe) {
+        for (double& x : g) {
+            x = (random() & 1) ? 1.0 : -1.0;
+        }
+        for (int k = 0; k < n; ++k) {
+            double sum = 0;
+            for (int j = 0; j < n; ++j) {
+                sum += B.element(j, k) * g[j];
+            }
+            Bg[k] = sum;
+        }
+        for (int i = 0; i < n; ++i) {
+            double sum = 0;
+            for (int k = 0; k < n; ++k) {
+                sum += A.element(k, i) * Bg[k];
+            }
+            productNorm2 += sum * sum / NB_PROBES;
+        }
+    }
+
+    // Samples needed for the target: ((sum of the weights)^2 - |A * B|^2) / s <= (target * |A * B|)^2
+    double excess = std::max(normSum * normSum - productNorm2, 0.0);
+    double wanted = targetRelativeError * targetRelativeError * productNorm2;
+    int nbSamples = n;
+    if (wanted > 0 && normSum > 0) {
+        nbSamples = static_cast<int>(std::min<double>(n, std::ceil(excess / wanted)));
+    }
+    if (nbSamples >= n) {
+        // multiply() needs a number of blocks per row dividing n
+        int nbBlocksPerRow = 1;
+        for (int d = 2; d * d <= 2 * engine.getThreadCount() && d <= n; ++d) {
+            if (n % d == 0) {
+                nbBlocksPerRow = d;
+            }
+        }
+        engine.multiply(A, B, C, nbBlocksPerRow);
+        report.nbSamples = n;
+        report.nbDistinctSamples = n;
+        report.isExact = true;
+        return report;
+    }
+    nbSamples = std::max(nbSamples, 1);
+
+    // Each draw of k adds A(:, k) * B(k, :) / (s * p_k), the draws of the same k are merged
+    std::discrete_distribution<int> draw(probabilities.begin(), probabilities.end());
+    std::vector<double> counts(n, 0.0);
+    for (int s = 0; s < nbSamples; ++s) {
+        counts[draw(random)] += 1;
+    }
+    std::vector<int> indices;
+    std::vector<double> weights;
+    for (int k = 0; k < n; ++k) {
+        if (counts[k] > 0) {
+            indices.push_back(k);
+            weights.push_back(counts[k] * normSum / (nbSamples * probabilities[k]));
+        }
+    }
+
+    int nbBlocksPerRow = engine.chooseBlocksPerRow(static_cast<long long>(n) * n);
+    SampledProduct<T> product{&A, &B, &C, indices.data(), weights.data(), static_cast<int>(indices.size()),
+                              (n + nbBlocksPerRow - 1) / nbBlocksPerRow};
+    long long tileWork = static_cast<long long>(product.blockSize) * product.blockSize * product.nbIndices;
+    engine.runTiles(nbBlocksPerRow, &computeSampledTile<T>, &product, tileWork);
+
+    report.nbSamples = nbSamples;
+    report.nbDistinctSamples = product.nbIndices;
+    report.expectedRelativeError = productNorm2 > 0 ? std::sqrt(excess / nbSamples / productNorm2) : 0.0;
+    return report;
+}
+
+#endif // APPROXIMATEMULTIPLY_H
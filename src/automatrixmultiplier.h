@@ -0,0 +1,246 @@
+#ifndef AUTOMATRIXMULTIPLIER_H
+#define AUTOMATRIXMULTIPLIER_H
+
+///
+/// Matrix multiplication dispatched to the fastest backend
+/// =======================================================
+///
+/// Small products are faster on the calling thread, since handing blocks over to a pool costs more than
+/// computing them, while large ones gain from the threads. Rather than guessing the crossover, the
+/// multiplier times every registered backend on the host for a range of sizes, once, and then routes each
+/// call to the backend that was the fastest for the closest size below. When the pool is already saturated
+/// by other callers, products up to twice the crossover run inline instead of queuing behind them.
+///
+/// All the backends use the same tile kernel, so the choice does not change the result.
+///
+
+#include <pcosynchro/pcomutex.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "abstractmatrixmultiplier.h"
+#include "matrix.h"
+#include "threadedmatrixmultiplier.h"
+#include "tilekernels.h"
+
+
+template<class T>
+class AutoMatrixMultiplier : public AbstractMatrixMultiplier<T>
+{
+public:
+    //! A way of computing C = A * B
+    using BackendFunction = std::function<void(const SquareMatrix<T>&, const SquareMatrix<T>&, SquareMatrix<T>&)>;
+
+    ///
+    /// \brief AutoMatrixMultiplier
+    /// \param nbThreads Number of threads of the threaded backend
+    ///
+    /// Registers the inline and threaded backends. The calibration runs on the first multiply(), or when
+    /// calibrate() is called.
+    ///
+    explicit AutoMatrixMultiplier(int nbThreads)
+        : nbThreads(nbThreads), threaded(std::make_unique<ThreadedMatrixMultiplier<T>>(nbThreads))
+    {
+        registerBackend("inline", [](const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C) {
+            computeTile(A, B, C, 1, 0, 0);
+        });
+        registerBackend("threaded", [this](const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C) {
+            threaded->multiply(A, B, C, chooseBlocksPerRow(A.size()));
+        });
+    }
+
+    ///
+    /// \brief Adds a backend to choose from, for instance an OpenMPMatrixMultiplier
+    /// \param name Name of the backend, returned by chooseBackend()
+    /// \param function Computes C = A * B, it must be reentrant
+    ///
+    /// The calibration is invalidated. Must not be called concurrently with multiply().
+    ///
+    void registerBackend(const std::string& name, BackendFunction function)
+    {
+        backends.push_back({name, std::move(function)});
+        isCalibrated.store(false, std::memory_order_release);
+    }
+
+    ///
+    /// \brief Times the backends on the host and builds the dispatch table
+    /// \param maxSize Largest size timed, the larger products use the backend chosen for it
+    ///
+    /// The sizes are powers of two from 8. Must not be called concurrently with multiply().
+    ///
+    void calibrate(int maxSize = DEFAULT_CALIBRATION_SIZE)
+    {
+        calibrationMutex.lock();
+        calibrateLocked(maxSize);
+        calibrationMutex.unlock();
+    }
+
+    ///
+    /// \brief Returns the name of the backend a product of size n would be sent to right now
+    ///
+    const std::string& chooseBackend(int n)
+    {
+        return backends[selectBackend(n)].name;
+    }
+
+    ///
+    /// \brief Computes C = A * B with the backend expected to be the fastest
+    ///
+    void multiply(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C) override
+    {
+        backends[selectBackend(A.size())].function(A, B, C);
+    }
+
+    ///
+    /// \brief Returns the underlying threaded multiplier, for instance to resize its pool
+    ///
+    ThreadedMatrixMultiplier<T>& getThreadedMultiplier()
+    {
+        return *threaded;
+    }
+
+    //! Largest size timed by default, a few milliseconds on a single core
+    static constexpr int DEFAULT_CALIBRATION_SIZE = 256;
+
+protected:
+    struct Backend
+    {
+        std::string name;
+        BackendFunction function;
+    };
+
+    //! Smallest size from which a backend was the fastest
+    struct Crossover
+    {
+        int size;
+        int backend;
+    };
+
+    static constexpr int INLINE_BACKEND = 0;
+
+    int nbThreads;
+    std::unique_ptr<ThreadedMatrixMultiplier<T>> threaded;
+    std::vector<Backend> backends;
+    std::vector<Crossover> crossovers; // By increasing size, only read once isCalibrated is set
+    int inlineCrossover{0};            // Largest timed size where the inline backend won
+    std::atomic<bool> isCalibrated{false};
+    PcoMutex calibrationMutex;         // Serializes the calibrations, the first multiply() calls may race for it
+
+    ///
+    /// \brief Builds the dispatch table, calibrationMutex held
+    ///
+    void calibrateLocked(int maxSize)
+    {
+        isCalibrated.store(false, std::memory_order_relaxed);
+        crossovers.clear();
+        inlineCrossover = 0;
+        for (int size = 8; size <= std::max(maxSize, 8); size *= 2) {
+            SquareMatrix<T> A(size);
+            SquareMatrix<T> B(size);
+            SquareMatrix<T> C(size);
+            for (int i = 0; i < size; ++i) {
+                for (int j = 0; j < size; ++j) {
+                    A.setElement(i, j, static_cast<T>((i + j) % 7));
+                    B.setElement(i, j, static_cast<T>((i * j) % 5));
+                }
+            }
+            int best = 0;
+            double bestSeconds = 0;
+            for (int backend = 0; backend < static_cast<int>(backends.size()); ++backend) {
+                double seconds = timeBackend(backends[backend].function, A, B, C);
+                if (backend == 0 || seconds < bestSeconds) {
+                    best = backend;
+                    bestSeconds = seconds;
+                }
+            }
+            if (best == INLINE_BACKEND) {
+                inlineCrossover = size;
+            }
+            // Only the sizes where the choice changes are kept
+            if (crossovers.empty() || crossovers.back().backend != best) {
+                crossovers.push_back({size, best});
+            }
+        }
+        isCalibrated.store(true, std::memory_order_release);
+    }
+
+    ///
+    /// \brief Returns the index of the backend for a product of size n
+    ///
+    /// Calibrates on the first call, the concurrent first callers waiting for that calibration.
+    ///
+    int selectBackend(int n)
+    {
+        if (!isCalibrated.load(std::memory_order_acquire)) {
+            calibrationMutex.lock();
+            if (!isCalibrated.load(std::memory_order_relaxed)) {
+                calibrateLocked(DEFAULT_CALIBRATION_SIZE);
+            }
+            calibrationMutex.unlock();
+        }
+        int backend = crossovers.front().backend;
+        for (const Crossover& crossover : crossovers) {
+            if (crossover.size <= n) {
+                backend = crossover.backend;
+            }
+        }
+        // A saturated pool would make the product wait, run it on the calling thread if it is small enough
+        if (backend != INLINE_BACKEND && n <= 2 * inlineCrossover) {
+            QueueMetrics metrics = threaded->getQueueMetrics();
+            if (metrics.nbQueuedJobs + metrics.nbBusyJobs >= nbThreads) {
+                backend = INLINE_BACKEND;
+            }
+        }
+        return backend;
+    }
+
+    ///
+    /// \brief Chooses how many blocks per row the threaded backend uses
+    ///
+    /// The smallest divisor of n giving at least two blocks per thread, with blocks of at least 16 rows
+    /// when possible so that a block is worth handing over.
+    ///
+    int chooseBlocksPerRow(int n) const
+    {
+        int chosen = 1;
+        for (int d = 1; d <= n; ++d) {
+            if (n % d != 0) {
+                continue;
+            }
+            if (n / d < 16 && d > 1) {
+                break;
+            }
+            chosen = d;
+            if (d * d >= 2 * nbThreads) {
+                break;
+            }
+        }
+        return chosen;
+    }
+
+    ///
+    /// \brief Returns the best time of a backend over a few runs, in seconds
+    ///
+    static double timeBackend(const BackendFunction& function, const SquareMatrix<T>& A, const SquareMatrix<T>& B,
+                              SquareMatrix<T>& C)
+    {
+        double best = 0;
+        for (int run = 0; run < 3; ++run) {
+            auto start = std::chrono::steady_clock::now();
+            function(A, B, C);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            if (run == 0 || elapsed.count() < best) {
+                best = elapsed.count();
+            }
+        }
+        return best;
+    }
+};
+
+#endif // AUTOMATRIXMULTIPLIER_H
@@ -0,0 +1,228 @@
+#ifndef CACHINGMATRIXMULTIPLIER_H
+#define CACHINGMATRIXMULTIPLIER_H
+
+///
+/// Cache of the results of a multiplier
+/// ====================================
+///
+/// A product whose operands were already multiplied is copied from the cache instead of being computed again.
+/// The results are keyed by a hash of the contents of A and B, or by version tags supplied by the caller when
+/// the contents are known to be unchanged, which saves the hashing. The least recently used results are
+/// dropped to stay within a memory budget.
+///
+/// Callers submitting a product that is being computed by another caller wait for its result instead of
+/// computing it a second time.
+///
+/// A 64-bit hash collision would return a wrong result. It is unlikely enough for the matrices of a request
+/// stream, the version tags are to be preferred when the operands are known.
+///
+
+#include <pcosynchro/pcohoaremonitor.h>
+
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+
+#include "abstractmatrixmultiplier.h"
+#include "matrix.h"
+#include "threadedmatrixmultiplier.h"
+
+
+///
+/// Counters of a CachingMatrixMultiplier
+///
+struct CacheStats
+{
+    long long nbHits{0};          // Results copied from the cache
+    long long nbMisses{0};        // Results computed
+    long long nbSharedInFlight{0}; // Results waited for while another caller computed them
+    long long nbEvictions{0};     // Results dropped to stay within the budget
+    long long nbBytes{0};         // Memory used by the results in the cache
+};
+
+
+template<class T>
+class CachingMatrixMultiplier : public AbstractMatrixMultiplier<T>, protected PcoHoareMonitor
+{
+public:
+    ///
+    /// \brief CachingMatrixMultiplier
+    /// \param multiplier The multiplier computing the products missing from the cache, it must outlive the cache
+    /// \param nbBlocksPerRow Number of blocks per row (or columns) of the products computed
+    /// \param budgetBytes Maximal memory used by the results kept
+    ///
+    CachingMatrixMultiplier(ThreadedMatrixMultiplier<T>& multiplier, int nbBlocksPerRow, long long budgetBytes)
+        : multiplier(multiplier), nbBlocksPerRow(nbBlocksPerRow), budgetBytes(budgetBytes)
+    {
+    }
+
+    ///
+    /// \brief Computes C = A * B, or copies it from the cache, the operands being identified by their contents
+    ///
+    void multiply(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C) override
+    {
+        multiply(Key{A.contentHash(), B.contentHash(), A.size(), false}, A, B, C);
+    }
+
+    ///
+    /// \brief Computes C = A * B, or copies it from the cache, the operands being identified by the caller
+    /// \param A First matrix
+    /// \param versionA Tag of the contents of A, the caller changes it whenever A changes
+    /// \param B Second matrix
+    /// \param versionB Tag of the contents of B
+    /// \param C Result of AxB
+    ///
+    void multiply(const SquareMatrix<T>& A, uint64_t versionA, const SquareMatrix<T>& B, uint64_t versionB,
+                  SquareMatrix<T>& C)
+    {
+        multiply(Key{versionA, versionB, A.size(), true}, A, B, C);
+    }
+
+    ///
+    /// \brief Changes the memory budget, dropping results if needed
+    ///
+    void setBudget(long long budgetBytes)
+    {
+        monitorIn();
+        this->budgetBytes = budgetBytes;
+        evictOverBudget();
+        monitorOut();
+    }
+
+    ///
+    /// \brief Drops all the results that are not being computed or copied
+    ///
+    void clear()
+    {
+        monitorIn();
+        long long budget = budgetBytes;
+        budgetBytes = 0;
+        evictOverBudget();
+        budgetBytes = budget;
+        monitorOut();
+    }
+
+    CacheStats getStats()
+    {
+        monitorIn();
+        CacheStats copy = stats;
+        monitorOut();
+        return copy;
+    }
+
+protected:
+    struct Key
+    {
+        uint64_t a;
+        uint64_t b;
+        int size;
+        bool isVersion; // Tags supplied by the caller, never equal to content hashes
+
+        bool operator==(const Key& other) const = default;
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const
+        {
+            return static_cast<size_t>(key.a * 31 + key.b + static_cast<uint64_t>(key.isVersion));
+        }
+    };
+
+    struct Entry
+    {
+        Key key;
+        SquareMatrix<T> result;
+        bool isReady{false};  // false while the first caller computes it
+        int nbUsers{0};       // Callers computing, waiting for or copying the result, which cannot be dropped
+        int nbWaiting{0};
+        Condition ready;
+
+        Entry(const Key& key, int size) : key(key), result(size) {}
+    };
+
+    ThreadedMatrixMultiplier<T>& multiplier;
+    int nbBlocksPerRow;
+    long long budgetBytes;
+
+    std::list<Entry> entries; // From the most to the least recently used
+    std::unordered_map<Key, typename std::list<Entry>::iterator, KeyHash> index;
+    CacheStats stats;
+
+    void multiply(const Key& key, const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C)
+    {
+        monitorIn();
+        auto found = index.find(key);
+        if (found != index.end()) {
+            Entry& entry = *found->second;
+            entries.splice(entries.begin(), entries, found->second);
+            entry.nbUsers++;
+            if (!entry.isReady) {
+                stats.nbSharedInFlight++;
+                entry.nbWaiting++;
+                wait(entry.ready);
+                entry.nbWaiting--;
+            }
+            else {
+                stats.nbHits++;
+            }
+            monitorOut();
+
+            // The entry cannot be dropped while we use it
+            C = entry.result;
+
+            monitorIn();
+            entry.nbUsers--;
+            evictOverBudget();
+            monitorOut();
+            return;
+        }
+
+        stats.nbMisses++;
+        entries.emplace_front(key, A.size());
+        Entry& entry = entries.front();
+        index.emplace(key, entries.begin());
+        entry.nbUsers++;
+        monitorOut();
+
+        multiplier.multiply(A, B, entry.result, nbBlocksPerRow);
+        C = entry.result;
+
+        monitorIn();
+        entry.isReady = true;
+        stats.nbBytes += bytesOf(entry);
+        // With a Hoare monitor, each waiter runs right away and stops waiting before the next signal
+        while (entry.nbWaiting > 0) {
+            signal(entry.ready);
+        }
+        entry.nbUsers--;
+        evictOverBudget();
+        monitorOut();
+    }
+
+    static long long bytesOf(const Entry& entry)
+    {
+        return static_cast<long long>(sizeof(T)) * entry.result.size() * entry.result.size();
+    }
+
+    ///
+    /// \brief Drops the least recently used results until the budget is met, monitor held
+    ///
+    /// The results in use are skipped, they are dropped by a later call once released.
+    ///
+    void evictOverBudget()
+    {
+        auto it = entries.end();
+        while (stats.nbBytes > budgetBytes && it != entries.begin()) {
+            --it;
+            if (it->isReady && it->nbUsers == 0) {
+                stats.nbBytes -= bytesOf(*it);
+                stats.nbEvictions++;
+                index.erase(it->key);
+                it = entries.erase(it);
+            }
+        }
+    }
+};
+
+#endif // CACHINGMATRIXMULTIPLIER_H
@@ -0,0 +1,391 @@
+#ifndef CHECKPOINTEDMULTIPLY_H
+#define CHECKPOINTEDMULTIPLY_H
+
+///
+/// Checkpointed product
+/// ====================
+///
+/// A product running for hours loses all its computed blocks if the process dies, their completion being only
+/// known by the counters of the Buffer. A checkpoint file, mapped in memory, keeps a copy of the computed
+/// blocks of C and a bitmap of the blocks it holds:
+///
+///     | header | bitmap, one bit per block, row-major | padding to a page | C, row-major |
+///
+/// Each block is copied to the file by the worker that computed it. Every interval, a thread of the checkpoint
+/// syncs the pages of the blocks copied since the last checkpoint to the disk, and only then marks them in the
+/// bitmap, which is synced in turn: a bit set on the disk always means that its block is on the disk. The
+/// workers never wait for the disk.
+///
+/// A resumed product reads the blocks of the bitmap back into C and only queues the missing ones. The header
+/// holds hashes of A and B, so that a checkpoint of other operands is rejected.
+///
+
+#include <pcosynchro/pcomutex.h>
+#include <pcosynchro/pcothread.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "matrix.h"
+#include "threadedmatrixmultiplier.h"
+
+
+///
+/// The blocks of a product saved in a memory-mapped file
+///
+template<class T>
+class TileCheckpoint
+{
+public:
+    TileCheckpoint() = default;
+
+    TileCheckpoint(const TileCheckpoint&) = delete;
+    TileCheckpoint& operator=(const TileCheckpoint&) = delete;
+
+    ~TileCheckpoint()
+    {
+        close();
+    }
+
+    ///
+    /// \brief Opens a checkpoint file, or creates it
+    /// \param path The file
+    /// \param A First matrix of the product
+    /// \param B Second matrix of the product
+    /// \param nbBlocksPerRow Number of blocks per row (or columns) of the product
+    /// \param interval Time between two syncs of the computed blocks, 0 syncs them as soon as possible
+    /// \param resume If true, keeps the blocks of an existing file, otherwise starts with no block
+    /// \return false if the file cannot be opened or mapped, or if resume is set and the file holds another
+    ///         product
+    ///
+    bool open(const std::string& path, const SquareMatrix<T>& A, const SquareMatrix<T>& B, int nbBlocksPerRow,
+              std::chrono::milliseconds interval, bool resume)
+    {
+        close();
+        Header expected{MAGIC, A.contentHash(), B.contentHash(), A.size(), nbBlocksPerRow,
+                        static_cast<int>(sizeof(T)), 0};
+        int n = A.size();
+        int nbTiles = nbBlocksPerRow * nbBlocksPerRow;
+        pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        dataOffset = (sizeof(Header) + (nbTiles + 7) / 8 + pageSize - 1) / pageSize * pageSize;
+        mappedSize = dataOffset + sizeof(T) * static_cast<size_t>(n) * n;
+
+        fd = ::open(path.c_str(), resume ? O_RDWR | O_CREAT : O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat status;
+        if (fstat(fd, &status) != 0) {
+            close();
+            return false;
+        }
+        bool isNew = status.st_size == 0;
+        if (!isNew && static_cast<size_t>(status.st_size) != mappedSize) {
+            close();
+            return false;
+        }
+        if (isNew && ftruncate(fd, static_cast<off_t>(mappedSize)) != 0) {
+            close();
+            return false;
+        }
+        void* address = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (address == MAP_FAILED) {
+            close();
+            return false;
+        }
+        map = static_cast<unsigned char*>(address);
+
+        if (isNew) {
+            std::memcpy(map, &expected, sizeof(Header));
+            msync(map, dataOffset, MS_SYNC);
+        }
+        else {
+            Header header;
+            std::memcpy(&header, map, sizeof(Header));
+            if (std::memcmp(&header, &expected, sizeof(Header)) != 0) {
+                close();
+                return false;
+            }
+        }
+        this->n = n;
+        this->nbBlocksPerRow = nbBlocksPerRow;
+        this->interval = interval;
+        pending.clear();
+        pending.reserve(nbTiles);
+        syncing.clear();
+        syncing.reserve(nbTiles);
+        isStopping.store(false);
+        syncThread = std::make_unique<PcoThread>(&TileCheckpoint::runSyncThread, this);
+        return true;
+    }
+
+    ///
+    /// \brief Syncs the pending blocks, then unmaps and closes the file
+    ///
+    void close()
+    {
+        if (syncThread) {
+            isStopping.store(true);
+            syncThread->join();
+            syncThread.reset();
+        }
+        if (map) {
+            sync();
+            munmap(map, mappedSize);
+            map = nullptr;
+        }
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    bool isOpen() const { return map != nullptr; }
+
+    //! Whether a block is synced to the disk
+    bool isTileDone(int blockI, int blockJ) const
+    {
+        syncMutex.lock();
+        bool isDone = isTileDoneLocked(blockI * nbBlocksPerRow + blockJ);
+        syncMutex.unlock();
+        return isDone;
+    }
+
+    //! Row-major indices of the blocks not synced to the disk
+    std::vector<int> missingTiles() const
+    {
+        std::vector<int> tiles;
+        syncMutex.lock();
+        for (int tile = 0; tile < nbBlocksPerRow * nbBlocksPerRow; ++tile) {
+            if (!isTileDoneLocked(tile)) {
+                tiles.push_back(tile);
+            }
+        }
+        syncMutex.unlock();
+        return tiles;
+    }
+
+    ///
+    /// \brief Copies the blocks of the checkpoint into C
+    ///
+    void restore(SquareMatrix<T>& C) const
+    {
+        int blockSize = n / nbBlocksPerRow;
+        syncMutex.lock();
+        for (int blockI = 0; blockI < nbBlocksPerRow; ++blockI) {
+            for (int blockJ = 0; blockJ < nbBlocksPerRow; ++blockJ) {
+                if (!isTileDoneLocked(blockI * nbBlocksPerRow + blockJ)) {
+                    continue;
+                }
+                for (int i = blockI * blockSize; i < (blockI + 1) * blockSize; ++i) {
+                    const T* row = data() + static_cast<size_t>(i) * n;
+                    for (int j = blockJ * blockSize; j < (blockJ + 1) * blockSize; ++j) {
+                        C.setElement(j, i, row[j]);
+                    }
+                }
+            }
+        }
+        syncMutex.unlock();
+    }
+
+    ///
+    /// \brief Copies a computed block of C to the file, to be synced by the next checkpoint
+    ///
+    /// Called by the workers, concurrently for different blocks.
+    ///
+    void tileComputed(const SquareMatrix<T>& C, int blockI, int blockJ)
+    {
+        int blockSize = n / nbBlocksPerRow;
+        for (int i = blockI * blockSize; i < (blockI + 1) * blockSize; ++i) {
+            std::memcpy(data() + static_cast<size_t>(i) * n + blockJ * blockSize,
+                        C.data() + static_cast<size_t>(i) * n + blockJ * blockSize, sizeof(T) * blockSize);
+        }
+        pendingMutex.lock();
+        pending.push_back(blockI * nbBlocksPerRow + blockJ);
+        pendingMutex.unlock();
+    }
+
+    ///
+    /// \brief Syncs the blocks copied since the last checkpoint and marks them in the bitmap
+    ///
+    void sync()
+    {
+        syncMutex.lock();
+        pendingMutex.lock();
+        syncing.clear();
+        pending.swap(syncing);
+        pendingMutex.unlock();
+
+        if (!syncing.empty()) {
+            // The blocks reach the disk before the bits that declare them
+            int blockSize = n / nbBlocksPerRow;
+            for (int tile : syncing) {
+                int blockI = tile / nbBlocksPerRow;
+                int blockJ = tile % nbBlocksPerRow;
+                size_t first = dataOffset + sizeof(T) * (static_cast<size_t>(blockI) * blockSize * n
+                                                         + static_cast<size_t>(blockJ) * blockSize);
+                size_t last = first + sizeof(T) * (static_cast<size_t>(blockSize - 1) * n + blockSize);
+                first = first / pageSize * pageSize;
+                msync(map + first, last - first, MS_SYNC);
+            }
+            for (int tile : syncing) {
+                bitmap()[tile / 8] |= static_cast<unsigned char>(1 << (tile % 8));
+            }
+            msync(map, dataOffset, MS_SYNC);
+        }
+        syncMutex.unlock();
+    }
+
+protected:
+    static constexpr uint64_t MAGIC = 0x31544e494f50434bULL; // "KCPOINT1"
+
+    struct Header
+    {
+        uint64_t magic;
+        uint64_t hashA;
+        uint64_t hashB;
+        int32_t size;
+        int32_t nbBlocksPerRow;
+        int32_t elementSize;
+        int32_t reserved;
+    };
+
+    int fd{-1};
+    unsigned char* map{nullptr};
+    size_t mappedSize{0};
+    size_t dataOffset{0};
+    int n{0};
+    int nbBlocksPerRow{0};
+    size_t pageSize{0};
+    std::chrono::milliseconds interval{0};
+
+    PcoMutex pendingMutex;                              // Protects pending, held without any I/O
+    std::vector<int> pending;                           // Blocks copied but not yet synced
+    mutable PcoMutex syncMutex;                         // Serializes the syncs, protects syncing and the bitmap
+    std::vector<int> syncing;                           // Blocks of the sync running
+    std::atomic<bool> isStopping{false};
+    std::unique_ptr<PcoThread> syncThread;
+
+    unsigned char* bitmap() const { return map + sizeof(Header); }
+
+    T* data() const { return reinterpret_cast<T*>(map + dataOffset); }
+
+    bool isTileDoneLocked(int tile) const { return (bitmap()[tile / 8] >> (tile % 8)) & 1; }
+
+    ///
+    /// \brief Syncs the copied blocks every interval until the checkpoint is closed
+    ///
+    void runSyncThread()
+    {
+        while (!isStopping.load()) {
+            // Sleeps in short slices, so that close() does not wait for a long interval
+            auto wakeUp = std::chrono::steady_clock::now() + std::max(interval, std::chrono::milliseconds(1));
+            for (auto now = std::chrono::steady_clock::now(); now < wakeUp && !isStopping.load();
+                 now = std::chrono::steady_clock::now()) {
+                auto left = std::chrono::duration_cast<std::chrono::microseconds>(wakeUp - now).count();
+                PcoThread::usleep(static_cast<uint64_t>(std::min<long long>(left, 10000)));
+            }
+            sync();
+        }
+    }
+};
+
+
+///
+/// A product saved to a checkpoint, shared by the callbacks of its blocks
+///
+template<class T>
+struct CheckpointedProduct
+{
+    TileCheckpoint<T>* checkpoint{nullptr};
+    const SquareMatrix<T>* C{nullptr};
+};
+
+
+///
+/// \brief Copies a block just computed to the checkpoint
+/// \param context The CheckpointedProduct
+/// \param blockI Row of the block in the grid
+/// \param blockJ Column of the block in the grid
+///
+template<class T>
+void checkpointTile(void* context, int blockI, int blockJ)
+{
+    const CheckpointedProduct<T>& product = *static_cast<const CheckpointedProduct<T>*>(context);
+    product.checkpoint->tileComputed(*product.C, blockI, blockJ);
+}
+
+
+///
+/// \brief Computes the blocks of C = A * B missing from a checkpoint, and saves them to it
+/// \param engine The multiplier whose pool computes the blocks
+/// \param A First matrix
+/// \param B Second matrix
+/// \param C Result of AxB
+/// \param nbBlocksPerRow Number of blocks per row (or columns), the one the checkpoint was opened with
+/// \param checkpoint An open checkpoint of this product, synced once all the blocks are computed
+/// \return Number of blocks computed, the others being read from the checkpoint
+///
+template<class T>
+int multiplyCheckpointed(ThreadedMatrixMultiplier<T>& engine, const SquareMatrix<T>& A, const SquareMatrix<T>& B,
+                         SquareMatrix<T>& C, int nbBlocksPerRow, TileCheckpoint<T>& checkpoint)
+{
+    checkpoint.restore(C);
+    std::vector<int> tiles = checkpoint.missingTiles();
+    CheckpointedProduct<T> product{&checkpoint, &C};
+    engine.multiplyTiles(A, B, C, nbBlocksPerRow, tiles, TileCallback{&checkpointTile<T>, &product});
+    checkpoint.sync();
+    return static_cast<int>(tiles.size());
+}
+
+
+///
+/// \brief Computes C = A * B, saving the computed blocks to a checkpoint file
+/// \param path The checkpoint file, overwritten
+/// \param interval Time between two syncs of the computed blocks
+/// \return false if the file cannot be created, C is then not computed
+///
+template<class T>
+bool multiplyWithCheckpoint(ThreadedMatrixMultiplier<T>& engine, const SquareMatrix<T>& A, const SquareMatrix<T>& B,
+                            SquareMatrix<T>& C, int nbBlocksPerRow, const std::string& path,
+                            std::chrono::milliseconds interval)
+{
+    TileCheckpoint<T> checkpoint;
+    if (!checkpoint.open(path, A, B, nbBlocksPerRow, interval, false)) {
+        return false;
+    }
+    multiplyCheckpointed(engine, A, B, C, nbBlocksPerRow, checkpoint);
+    return true;
+}
+
+
+///
+/// \brief Resumes a product saved to a checkpoint file, only computing the blocks missing from it
+/// \param path The checkpoint file of a product of the same A, B and number of blocks
+/// \param interval Time between two syncs of the computed blocks
+/// \return Number of blocks computed, -1 if the file cannot be opened or holds another product
+///
+template<class T>
+int resumeCheckpointed(ThreadedMatrixMultiplier<T>& engine, const SquareMatrix<T>& A, const SquareMatrix<T>& B,
+                       SquareMatrix<T>& C, int nbBlocksPerRow, const std::string& path,
+                       std::chrono::milliseconds interval)
+{
+    TileCheckpoint<T> checkpoint;
+    if (!checkpoint.open(path, A, B, nbBlocksPerRow, interval, true)) {
+        return -1;
+    }
+    return multiplyCheckpointed(engine, A, B, C, nbBlocksPerRow, checkpoint);
+}
+
+#endif // CHECKPOINTEDMULTIPLY_H
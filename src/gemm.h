@@ -0,0 +1,139 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+///
+/// General matrix product with the BLAS semantics
+/// ==============================================
+///
+/// C = alpha * op(A) * op(B) + beta * C, with column-major matrices of any shape, leading dimensions and
+/// op(X) = X or X^T. The M x N result is cut into a grid of blocks, each one computed by a worker of a
+/// ThreadedMatrixMultiplier with the loop orders of the reference BLAS, so the columns are read contiguously.
+///
+
+#include <algorithm>
+#include <cstddef>
+
+#include "threadedmatrixmultiplier.h"
+
+
+///
+/// A gemm problem, shared by all its blocks
+///
+template<class T>
+struct GemmProblem
+{
+    bool transA{false};
+    bool transB{false};
+    int m{0};
+    int n{0};
+    int k{0};
+    T alpha{1};
+    const T* a{nullptr};
+    int lda{0};
+    const T* b{nullptr};
+    int ldb{0};
+    T beta{0};
+    T* c{nullptr};
+    int ldc{0};
+    int blockRows{0};    // Rows of C per block
+    int blockColumns{0}; // Columns of C per block
+};
+
+
+///
+/// \brief Computes the block (blockI, blockJ) of a gemm problem
+/// \param context The GemmProblem
+/// \param blockI Row of the block in the grid
+/// \param blockJ Column of the block in the grid
+///
+template<class T>
+void computeGemmTile(void* context, int blockI, int blockJ)
+{
+    const GemmProblem<T>& p = *static_cast<const GemmProblem<T>*>(context);
+    int firstRow = blockI * p.blockRows;
+    int lastRow = std::min(p.m, firstRow + p.blockRows);
+    int firstColumn = blockJ * p.blockColumns;
+    int lastColumn = std::min(p.n, firstColumn + p.blockColumns);
+
+    // Offsets in std::ptrdiff_t, as a leading dimension times an index can overflow an int
+    auto opB = [&](int l, int j) {
+        return p.transB ? p.b[j + static_cast<std::ptrdiff_t>(l) * p.ldb]
+                        : p.b[l + static_cast<std::ptrdiff_t>(j) * p.ldb];
+    };
+
+    for (int j = firstColumn; j < lastColumn; ++j) {
+        T* c = p.c + static_cast<std::ptrdiff_t>(j) * p.ldc;
+        if (p.transA) {
+            // C(i, j) = alpha * dot(column i of A, column j of op(B)) + beta * C(i, j). With alpha = 0, A and B
+            // are not read, as they may hold NaNs.
+            if (p.alpha == T(0)) {
+                for (int i = firstRow; i < lastRow; ++i) {
+                    c[i] = p.beta == T(0) ? T(0) : p.beta * c[i];
+                }
+                continue;
+            }
+            for (int i = firstRow; i < lastRow; ++i) {
+                const T* a = p.a + static_cast<std::ptrdiff_t>(i) * p.lda;
+                T sum = 0;
+                for (int l = 0; l < p.k; ++l) {
+                    sum += a[l] * opB(l, j);
+                }
+                c[i] = p.beta == T(0) ? p.alpha * sum : p.alpha * sum + p.beta * c[i];
+            }
+        }
+        else {
+            // Column j of C is scaled, then updated with each column of A in turn. With beta = 0, C is not
+            // read, as it may hold NaNs.
+            for (int i = firstRow; i < lastRow; ++i) {
+                c[i] = p.beta == T(0) ? T(0) : p.beta * c[i];
+            }
+            if (p.alpha == T(0)) {
+                continue;
+            }
+            for (int l = 0; l < p.k; ++l) {
+                T factor = p.alpha * opB(l, j);
+                const T* a = p.a + static_cast<std::ptrdiff_t>(l) * p.lda;
+                for (int i = firstRow; i < lastRow; ++i) {
+                    c[i] += a[i] * factor;
+                }
+            }
+        }
+    }
+}
+
+
+///
+/// \brief C = alpha * op(A) * op(B) + beta * C, column-major
+/// \param engine The multiplier whose pool computes the blocks
+/// \param transA true to use A^T, A being then k x m
+/// \param transB true to use B^T, B being then n x k
+/// \param m Rows of op(A) and C
+/// \param n Columns of op(B) and C
+/// \param k Columns of op(A), rows of op(B)
+/// \param alpha Scale of the product
+/// \param a First matrix, lda >= its number of rows
+/// \param lda Leading dimension of a
+/// \param b Second matrix, ldb >= its number of rows
+/// \param ldb Leading dimension of b
+/// \param beta Scale of C, C is not read when beta = 0
+/// \param c Result, ldc >= m
+/// \param ldc Leading dimension of c
+///
+/// The arguments are assumed valid, see pcoblas.cpp for the checks of the BLAS interface.
+///
+template<class T>
+void gemm(ThreadedMatrixMultiplier<T>& engine, bool transA, bool transB, int m, int n, int k, T alpha, const T* a,
+          int lda, const T* b, int ldb, T beta, T* c, int ldc)
+{
+    if (m == 0 || n == 0) {
+        return;
+    }
+    // Blocks of at least 32 x 32 elements along the shorter side of C
+    int nbBlocksPerRow = engine.chooseBlocksPerRow(static_cast<long long>(std::min(m, n)) * std::min(m, n));
+    GemmProblem<T> problem{transA, transB, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc,
+                           (m + nbBlocksPerRow - 1) / nbBlocksPerRow, (n + nbBlocksPerRow - 1) / nbBlocksPerRow};
+    long long tileWork = static_cast<long long>(problem.blockRows) * problem.blockColumns * std::max(k, 1);
+    engine.runTiles(nbBlocksPerRow, &computeGemmTile<T>, &problem, tileWork);
+}
+
+#endif // GEMM_H
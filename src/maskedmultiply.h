@@ -0,0 +1,137 @@
+#ifndef MASKEDMULTIPLY_H
+#define MASKEDMULTIPLY_H
+
+///
+/// Masked product (SDDMM)
+/// ======================
+///
+/// Computes only the elements of C = A * B at the positions of a sparse pattern, as graph attention or the
+/// gradients of a matrix completion need. Each element is the dot product of a row of A with a column of B.
+/// B is transposed once so that both are contiguous, which lets the compiler vectorize the dot products.
+///
+/// The rows of a pattern may hold very different numbers of elements, so the work is not split by rows but
+/// into chunks holding the same number of elements, each chunk being a job of a ThreadedMatrixMultiplier.
+///
+
+#include <algorithm>
+#include <vector>
+
+#include "matrix.h"
+#include "threadedmatrixmultiplier.h"
+
+
+///
+/// A sparse pattern in the CSR format: the columns of row i are columns[rowOffsets[i]] to
+/// columns[rowOffsets[i + 1] - 1]
+///
+struct SparsePattern
+{
+    std::vector<int> rowOffsets; // Number of rows + 1 offsets, the first one being 0
+    std::vector<int> columns;
+
+    int getNbRows() const { return static_cast<int>(rowOffsets.size()) - 1; }
+
+    int getNbElements() const { return static_cast<int>(columns.size()); }
+};
+
+
+///
+/// A masked product, shared by all its chunks
+///
+template<class T>
+struct MaskedProduct
+{
+    const T* A;             // Row-major, n x n
+    const T* Bt;            // B transposed, row-major
+    const SparsePattern* mask;
+    T* values;              // One per element of the mask
+    int n;
+    int nbBlocksPerRow;     // Of the grid of jobs, each job being a chunk
+    int nbChunks;
+};
+
+
+///
+/// \brief Returns the dot product of two contiguous vectors
+///
+template<class T>
+T dotProduct(const T* x, const T* y, int n)
+{
+    T sum = 0;
+#ifdef _OPENMP
+#pragma omp simd reduction(+ : sum)
+#endif
+    for (int k = 0; k < n; ++k) {
+        sum += x[k] * y[k];
+    }
+    return sum;
+}
+
+
+///
+/// \brief Computes one chunk of the elements of a masked product
+/// \param context The MaskedProduct
+///
+/// The job (blockI, blockJ) of the grid is the chunk blockI * nbBlocksPerRow + blockJ.
+///
+template<class T>
+void computeMaskedChunk(void* context, int blockI, int blockJ)
+{
+    const MaskedProduct<T>& p = *static_cast<const MaskedProduct<T>*>(context);
+    const SparsePattern& mask = *p.mask;
+    long long chunk = static_cast<long long>(blockI) * p.nbBlocksPerRow + blockJ;
+    int first = static_cast<int>(chunk * mask.getNbElements() / p.nbChunks);
+    int last = static_cast<int>((chunk + 1) * mask.getNbElements() / p.nbChunks);
+    if (first >= last) {
+        return;
+    }
+
+    // The row of the first element, the chunk may start in the middle of it
+    int row = static_cast<int>(std::upper_bound(mask.rowOffsets.begin(), mask.rowOffsets.end(), first)
+                               - mask.rowOffsets.begin()) - 1;
+    for (int e = first; e < last; ++e) {
+        while (mask.rowOffsets[row + 1] <= e) {
+            row++;
+        }
+        p.values[e] = dotProduct(p.A + static_cast<size_t>(row) * p.n,
+                                 p.Bt + static_cast<size_t>(mask.columns[e]) * p.n, p.n);
+    }
+}
+
+
+///
+/// \brief Computes the elements of A * B at the positions of a sparse pattern
+/// \param engine The multiplier whose pool computes the chunks
+/// \param A First matrix
+/// \param B Second matrix
+/// \param mask Positions to compute, with A.size() rows and columns lower than A.size()
+/// \return The value of each element of the mask, in the order of mask.columns
+///
+template<class T>
+std::vector<T> multiplyMasked(ThreadedMatrixMultiplier<T>& engine, const SquareMatrix<T>& A,
+                              const SquareMatrix<T>& B, const SparsePattern& mask)
+{
+    int n = A.size();
+    int nbElements = mask.getNbElements();
+    std::vector<T> values(nbElements);
+    if (nbElements == 0) {
+        return values;
+    }
+
+    std::vector<T> Bt(static_cast<size_t>(n) * n);
+    for (int k = 0; k < n; ++k) {
+        for (int j = 0; j < n; ++j) {
+            Bt[static_cast<size_t>(j) * n + k] = B.element(j, k);
+        }
+    }
+
+    // Chunks of at least 64 mask elements
+    int nbBlocksPerRow = engine.chooseBlocksPerRow(nbElements, 64);
+    MaskedProduct<T> product{A.data(), Bt.data(), &mask, values.data(), n, nbBlocksPerRow,
+                             nbBlocksPerRow * nbBlocksPerRow};
+    long long tileWork = static_cast<long long>(nbElements) / product.nbChunks * n;
+    engine.runTiles(nbBlocksPerRow, &computeMaskedChunk<T>, &product, tileWork);
+    return values;
+}
+
+#endif // MASKEDMULTIPLY_H
@@ -1,6 +1,8 @@
 #ifndef MATRIX_H
 #define MATRIX_H
 
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <vector>
 
@@ -19,6 +21,8 @@ public:
         array = std::vector<T>(sx * sy);
         sizeX = sx;
         sizeY = sy;
+        dirtyColumns = std::vector<bool>(sx);
+        dirtyRows = std::vector<bool>(sy);
     }
 
     virtual ~Matrix() = default;
@@ -33,6 +37,62 @@ public:
         array[sizeX * y + x] = value;
     }
 
+    /**
+     * Sets an element and marks its row and its column as modified, so that
+     * an incremental product only recomputes what depends on them.
+     * Unlike setElement(), it must not be called by several threads at once.
+     */
+    void updateElement(int x, int y, T value)
+    {
+        array[sizeX * y + x] = value;
+        dirtyColumns[x] = true;
+        dirtyRows[y] = true;
+    }
+
+    /**
+     * Marks the rows firstY to lastY - 1 as modified, after they were
+     * written with setElement(). Every modified element must lie in a marked
+     * row and in a marked column, so all the columns are marked as well.
+     */
+    void markRowsDirty(int firstY, int lastY)
+    {
+        for (int y = firstY; y < lastY; y++) {
+            dirtyRows[y] = true;
+        }
+        if (firstY < lastY) {
+            dirtyColumns.assign(sizeX, true);
+        }
+    }
+
+    /**
+     * Marks the columns firstX to lastX - 1 as modified, after they were
+     * written with setElement(). All the rows are marked as well, see
+     * markRowsDirty().
+     */
+    void markColumnsDirty(int firstX, int lastX)
+    {
+        for (int x = firstX; x < lastX; x++) {
+            dirtyColumns[x] = true;
+        }
+        if (firstX < lastX) {
+            dirtyRows.assign(sizeY, true);
+        }
+    }
+
+    [[nodiscard]] bool isRowDirty(int y) const { return dirtyRows[y]; }
+
+    [[nodiscard]] bool isColumnDirty(int x) const { return dirtyColumns[x]; }
+
+    /**
+     * Forgets the modifications, done by the incremental products once they
+     * took them into account.
+     */
+    void clearDirty()
+    {
+        dirtyColumns.assign(sizeX, false);
+        dirtyRows.assign(sizeY, false);
+    }
+
     void print() const
     {
         for (int y = 0; y < sizeY; y++) {
@@ -43,6 +103,38 @@ public:
         }
     }
 
+    /**
+     * The elements, row after row.
+     */
+    [[nodiscard]] const T* data() const { return array.data(); }
+
+    /**
+     * Returns a 64-bit hash of the elements, which reads them once.
+     * The caches and the checkpoint files identify the operands by it, so it
+     * must stay the same from one version to the next.
+     */
+    [[nodiscard]] uint64_t contentHash() const
+    {
+        // FNV-1a on 64-bit words rather than on bytes
+        const auto* bytes = reinterpret_cast<const unsigned char*>(array.data());
+        size_t size = sizeof(T) * array.size();
+        uint64_t hash = 0xcbf29ce484222325ULL ^ size;
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+            uint64_t word;
+            std::memcpy(&word, bytes + i, sizeof(word));
+            hash = (hash ^ word) * 0x100000001b3ULL;
+        }
+        for (; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+        }
+        // Final mix, so that all the bits of the last words reach the low bits used by the hash tables
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
     [[nodiscard]] int getSizeX() const { return sizeX; }
 
     [[nodiscard]] int getSizeY() const { return sizeY; }
@@ -70,6 +162,8 @@ protected:
     std::vector<T> array;
     int sizeX;
     int sizeY;
+    std::vector<bool> dirtyColumns; // Modified since the last incremental product
+    std::vector<bool> dirtyRows;
 };
 
 /**
@@ -82,6 +176,29 @@ class SquareMatrix : public Matrix<T>
 public:
     SquareMatrix(int size) : Matrix<T>(size, size) {}
 
+    /**
+     * Evaluates an expression built with the operators of matrixexpression.h,
+     * such as A * B + D, in one pass and without temporary matrix.
+     */
+    template<class Expression>
+        requires requires { Expression::isMatrixExpression; }
+    SquareMatrix& operator=(const Expression& expression)
+    {
+        expression.evaluateInto(*this);
+        return *this;
+    }
+
+    /**
+     * Adds an expression of matrixexpression.h to this matrix, in one pass.
+     */
+    template<class Expression>
+        requires requires { Expression::isMatrixExpression; }
+    SquareMatrix& operator+=(const Expression& expression)
+    {
+        expression.accumulateInto(*this);
+        return *this;
+    }
+
     int size() const
     {
         return this->sizeX;
@@ -0,0 +1,366 @@
+#ifndef MATRIXEXPRESSION_H
+#define MATRIXEXPRESSION_H
+
+///
+/// Matrix Expressions
+/// ==================
+///
+/// The operators on SquareMatrix build a tree of references to the operands instead of computing anything:
+///
+///     C = A * B + 2 * (D * E) - F;
+///
+/// The tree is evaluated on assignment, or added to C by C += ..., in a single pass over C. Each block of C is
+/// a job of a ThreadedMatrixMultiplier which computes the dot products of its elements and adds the scaled
+/// element-wise terms in the same loop, so there is no temporary matrix and C is written once.
+///
+/// The expressions are sums and differences of products of two matrices and of matrices, each one scaled by
+/// a scalar. A product of expressions, as (A + B) * C, is not supported since it needs a temporary.
+///
+/// The assignment uses a multiplier running on SharedWorkerPool::instance(), evaluate() takes another one.
+///
+
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <type_traits>
+#include <utility>
+
+#include "matrix.h"
+#include "threadedmatrixmultiplier.h"
+
+
+///
+/// An expression flattened into the list of its products and terms, shared by all the blocks of C
+///
+template<class T, int NB_PRODUCTS, int NB_TERMS>
+struct FusedExpression
+{
+    struct Product
+    {
+        const SquareMatrix<T>* A;
+        const SquareMatrix<T>* B;
+        T scale;
+    };
+
+    struct Term
+    {
+        const SquareMatrix<T>* M;
+        T scale;
+    };
+
+    std::array<Product, NB_PRODUCTS> products{};
+    std::array<Term, NB_TERMS> terms{};
+    int nbProducts{0};
+    int nbTerms{0};
+    SquareMatrix<T>* C{nullptr};
+    int blockSize{0}; // Rows (and columns) of C per block
+
+    void addProduct(const SquareMatrix<T>& A, const SquareMatrix<T>& B, T scale)
+    {
+        products[nbProducts++] = {&A, &B, scale};
+    }
+
+    void addTerm(const SquareMatrix<T>& M, T scale)
+    {
+        terms[nbTerms++] = {&M, scale};
+    }
+};
+
+
+template<class T, class Expression>
+void evaluate(ThreadedMatrixMultiplier<T>& engine, SquareMatrix<T>& C, const Expression& expression);
+
+///
+/// \brief Returns the multiplier evaluating the assignments of expressions
+///
+template<class T>
+ThreadedMatrixMultiplier<T>& expressionEngine()
+{
+    static ThreadedMatrixMultiplier<T> multiplier(SharedWorkerPool::instance());
+    return multiplier;
+}
+
+
+template<class T>
+class MatrixOperand;
+
+template<class Left, class Right>
+class SumExpression;
+
+
+///
+/// Base of the nodes of an expression, Derived giving NB_PRODUCTS, NB_TERMS, size() and collect()
+///
+template<class Derived, class T>
+class MatrixExpression
+{
+public:
+    using ValueType = T;
+    static constexpr bool isMatrixExpression = true;
+
+    ///
+    /// \brief Evaluates the expression into C, called by SquareMatrix::operator=
+    ///
+    void evaluateInto(SquareMatrix<T>& C) const
+    {
+        evaluate(expressionEngine<T>(), C, static_cast<const Derived&>(*this));
+    }
+
+    ///
+    /// \brief Adds the expression to C, called by SquareMatrix::operator+=
+    ///
+    void accumulateInto(SquareMatrix<T>& C) const
+    {
+        evaluate(expressionEngine<T>(), C,
+                 SumExpression<MatrixOperand<T>, Derived>(MatrixOperand<T>(C), static_cast<const Derived&>(*this)));
+    }
+};
+
+
+///
+/// A matrix used as an element-wise term
+///
+template<class T>
+class MatrixOperand : public MatrixExpression<MatrixOperand<T>, T>
+{
+public:
+    static constexpr int NB_PRODUCTS = 0;
+    static constexpr int NB_TERMS = 1;
+
+    explicit MatrixOperand(const SquareMatrix<T>& M) : M(&M) {}
+
+    int size() const { return M->size(); }
+
+    template<class Fused>
+    void collect(Fused& fused, T scale) const
+    {
+        fused.addTerm(*M, scale);
+    }
+
+private:
+    const SquareMatrix<T>* M;
+};
+
+
+///
+/// The product of two matrices
+///
+template<class T>
+class ProductExpression : public MatrixExpression<ProductExpression<T>, T>
+{
+public:
+    static constexpr int NB_PRODUCTS = 1;
+    static constexpr int NB_TERMS = 0;
+
+    ProductExpression(const SquareMatrix<T>& A, const SquareMatrix<T>& B) : A(&A), B(&B) {}
+
+    int size() const { return A->size(); }
+
+    template<class Fused>
+    void collect(Fused& fused, T scale) const
+    {
+        fused.addProduct(*A, *B, scale);
+    }
+
+private:
+    const SquareMatrix<T>* A;
+    const SquareMatrix<T>* B;
+};
+
+
+///
+/// The sum of two expressions
+///
+template<class Left, class Right>
+class SumExpression : public MatrixExpression<SumExpression<Left, Right>, typename Left::ValueType>
+{
+public:
+    using T = typename Left::ValueType;
+    static constexpr int NB_PRODUCTS = Left::NB_PRODUCTS + Right::NB_PRODUCTS;
+    static constexpr int NB_TERMS = Left::NB_TERMS + Right::NB_TERMS;
+
+    SumExpression(const Left& left, const Right& right) : left(left), right(right) {}
+
+    int size() const { return left.size(); }
+
+    template<class Fused>
+    void collect(Fused& fused, T scale) const
+    {
+        left.collect(fused, scale);
+        right.collect(fused, scale);
+    }
+
+private:
+    Left left;
+    Right right;
+};
+
+
+///
+/// An expression multiplied by a scalar
+///
+template<class Operand>
+class ScaledExpression : public MatrixExpression<ScaledExpression<Operand>, typename Operand::ValueType>
+{
+public:
+    using T = typename Operand::ValueType;
+    static constexpr int NB_PRODUCTS = Operand::NB_PRODUCTS;
+    static constexpr int NB_TERMS = Operand::NB_TERMS;
+
+    ScaledExpression(const Operand& operand, T factor) : operand(operand), factor(factor) {}
+
+    int size() const { return operand.size(); }
+
+    template<class Fused>
+    void collect(Fused& fused, T scale) const
+    {
+        operand.collect(fused, scale * factor);
+    }
+
+private:
+    Operand operand;
+    T factor;
+};
+
+
+///
+/// A square matrix or an expression, the operands of the operators
+///
+template<class T>
+void asSquareMatrix(const SquareMatrix<T>&);
+
+template<class X>
+concept ExpressionOperand = requires { X::isMatrixExpression; } || requires (const X& x) { asSquareMatrix(x); };
+
+template<class T>
+MatrixOperand<T> toExpression(const SquareMatrix<T>& M)
+{
+    return MatrixOperand<T>(M);
+}
+
+template<class Expression>
+    requires requires { Expression::isMatrixExpression; }
+const Expression& toExpression(const Expression& expression)
+{
+    return expression;
+}
+
+template<class X>
+using ExpressionOf = std::remove_cvref_t<decltype(toExpression(std::declval<const X&>()))>;
+
+template<class X>
+using ScalarOf = typename ExpressionOf<X>::ValueType;
+
+
+template<class T>
+ProductExpression<T> operator*(const SquareMatrix<T>& A, const SquareMatrix<T>& B)
+{
+    return ProductExpression<T>(A, B);
+}
+
+template<ExpressionOperand X>
+ScaledExpression<ExpressionOf<X>> operator*(ScalarOf<X> factor, const X& x)
+{
+    return ScaledExpression<ExpressionOf<X>>(toExpression(x), factor);
+}
+
+template<ExpressionOperand X>
+ScaledExpression<ExpressionOf<X>> operator*(const X& x, ScalarOf<X> factor)
+{
+    return ScaledExpression<ExpressionOf<X>>(toExpression(x), factor);
+}
+
+template<ExpressionOperand X>
+ScaledExpression<ExpressionOf<X>> operator-(const X& x)
+{
+    return ScaledExpression<ExpressionOf<X>>(toExpression(x), ScalarOf<X>(-1));
+}
+
+template<ExpressionOperand L, ExpressionOperand R>
+    requires std::same_as<ScalarOf<L>, ScalarOf<R>>
+SumExpression<ExpressionOf<L>, ExpressionOf<R>> operator+(const L& left, const R& right)
+{
+    return SumExpression<ExpressionOf<L>, ExpressionOf<R>>(toExpression(left), toExpression(right));
+}
+
+template<ExpressionOperand L, ExpressionOperand R>
+    requires std::same_as<ScalarOf<L>, ScalarOf<R>>
+SumExpression<ExpressionOf<L>, ScaledExpression<ExpressionOf<R>>> operator-(const L& left, const R& right)
+{
+    return {toExpression(left), -right};
+}
+
+
+///
+/// \brief Computes the block (blockI, blockJ) of C, the products and the terms of its elements at once
+/// \param context The FusedExpression
+/// \param blockI Row of the block
+/// \param blockJ Column of the block
+///
+/// An operand of the terms may be C itself, each element being read before being written.
+///
+template<class T, int NB_PRODUCTS, int NB_TERMS>
+void computeExpressionTile(void* context, int blockI, int blockJ)
+{
+    const auto& e = *static_cast<const FusedExpression<T, NB_PRODUCTS, NB_TERMS>*>(context);
+    int n = e.C->size();
+    int lastRow = std::min(n, (blockI + 1) * e.blockSize);
+    int lastColumn = std::min(n, (blockJ + 1) * e.blockSize);
+
+    for (int i = blockI * e.blockSize; i < lastRow; ++i) {
+        for (int j = blockJ * e.blockSize; j < lastColumn; ++j) {
+            T value = 0;
+            for (const auto& product : e.products) {
+                T sum = 0;
+                for (int k = 0; k < n; ++k) {
+                    sum += product.A->element(k, i) * product.B->element(j, k);
+                }
+                value += product.scale * sum;
+            }
+            for (const auto& term : e.terms) {
+                value += term.scale * term.M->element(j, i);
+            }
+            e.C->setElement(j, i, value);
+        }
+    }
+}
+
+
+///
+/// \brief Evaluates an expression into C, in one pass and without temporary
+/// \param engine The multiplier whose pool computes the blocks
+/// \param C Result, of the size of the operands
+/// \param expression An expression built with the operators above
+///
+/// If C is an operand of a product, a block would overwrite elements that other blocks still have to read:
+/// the expression is then evaluated into a temporary, copied into C.
+///
+template<class T, class Expression>
+void evaluate(ThreadedMatrixMultiplier<T>& engine, SquareMatrix<T>& C, const Expression& expression)
+{
+    FusedExpression<T, Expression::NB_PRODUCTS, Expression::NB_TERMS> fused;
+    expression.collect(fused, T(1));
+
+    int n = expression.size();
+    for (const auto& product : fused.products) {
+        if (product.A == &C || product.B == &C) {
+            SquareMatrix<T> result(n);
+            evaluate(engine, result, expression);
+            C = result;
+            return;
+        }
+    }
+    if (n == 0) {
+        return;
+    }
+
+    int nbBlocksPerRow = engine.chooseBlocksPerRow(static_cast<long long>(n) * n);
+    fused.C = &C;
+    fused.blockSize = (n + nbBlocksPerRow - 1) / nbBlocksPerRow;
+    long long tileWork = static_cast<long long>(fused.blockSize) * fused.blockSize
+                         * (static_cast<long long>(fused.nbProducts) * n + fused.nbTerms);
+    engine.runTiles(nbBlocksPerRow, &computeExpressionTile<T, Expression::NB_PRODUCTS, Expression::NB_TERMS>,
+                    &fused, tileWork);
+}
+
+#endif // MATRIXEXPRESSION_H
@@ -0,0 +1,218 @@
+#ifndef MULTIPLYAWAITABLE_H
+#define MULTIPLYAWAITABLE_H
+
+///
+/// Coroutine Interface
+/// ===================
+///
+/// Lets a C++20 coroutine co_await a product computed by a ThreadedMatrixMultiplier:
+///
+///     bool completed = co_await multiplyAsync(multiplier, A, B, C, nbBlocksPerRow);
+///
+/// The coroutine is suspended while the blocks are computed, no thread waits for it. It is resumed either
+/// directly by the worker finishing the last block, or through a CoroutineExecutor given by the caller.
+/// Resumed by a worker, the coroutine runs as a job until its next suspension: the products it awaits or
+/// starts do not block that worker on the admission to the queue, and those it waits for are computed by it.
+/// Several products are awaited together with whenAll(), which resumes the coroutine once, after the last one.
+/// The awaitables live in the frame of the coroutine, so awaiting a product does not allocate.
+///
+
+#include <atomic>
+#include <coroutine>
+#include <vector>
+
+#include "threadedmatrixmultiplier.h"
+
+
+///
+/// Interface of the executors a coroutine can be resumed on, for instance the event loop of a service
+///
+class CoroutineExecutor
+{
+public:
+    ///
+    /// \brief Schedules the resumption of a coroutine, must not resume it from within the call
+    ///
+    virtual void post(std::coroutine_handle<> handle) = 0;
+
+    virtual ~CoroutineExecutor() = default;
+};
+
+
+template<class T>
+class MultiplyGroup;
+
+
+///
+/// Awaitable computing C = A * B. co_await returns false if the product was aborted by the destruction
+/// of the multiplier, in which case C is incomplete.
+///
+template<class T>
+class MultiplyAwaitable
+{
+public:
+    ///
+    /// \brief MultiplyAwaitable
+    /// \param multiplier The multiplier computing the product, it must outlive the awaitable
+    /// \param A First matrix
+    /// \param B Second matrix
+    /// \param C Result of AxB
+    /// \param nbBlocksPerRow Number of blocks per row (or columns)
+    /// \param executor Executor to resume the coroutine on, nullptr to resume it on the worker
+    ///
+    MultiplyAwaitable(ThreadedMatrixMultiplier<T>& multiplier, const SquareMatrix<T>& A, const SquareMatrix<T>& B,
+                      SquareMatrix<T>& C, int nbBlocksPerRow, CoroutineExecutor* executor = nullptr)
+        : multiplier(&multiplier), A(&A), B(&B), C(&C), nbBlocksPerRow(nbBlocksPerRow), executor(executor)
+    {
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        waiter = handle;
+        start();
+    }
+
+    bool await_resume() const noexcept
+    {
+        return completed;
+    }
+
+protected:
+    friend class MultiplyGroup<T>;
+
+    ThreadedMatrixMultiplier<T>* multiplier;
+    const SquareMatrix<T>* A;
+    const SquareMatrix<T>* B;
+    SquareMatrix<T>* C;
+    int nbBlocksPerRow;
+    CoroutineExecutor* executor;
+
+    std::coroutine_handle<> waiter;
+    MultiplyGroup<T>* group{nullptr};  // Notified instead of resuming the waiter, when awaited with whenAll()
+    bool completed{false};
+
+    ///
+    /// \brief Queues the product, the awaitable must not be touched afterwards since it may already be resumed
+    ///
+    void start()
+    {
+        multiplier->startMultiply(*A, *B, *C, nbBlocksPerRow, CompletionCallback{&MultiplyAwaitable::productDone, this});
+    }
+
+    ///
+    /// \brief Called by the multiplier once the product is over
+    ///
+    static void productDone(void* context, bool completed)
+    {
+        auto* awaitable = static_cast<MultiplyAwaitable*>(context);
+        awaitable->completed = completed;
+        if (awaitable->group) {
+            awaitable->group->productDone();
+        }
+        else {
+            resume(awaitable->waiter, awaitable->executor);
+        }
+    }
+
+    static void resume(std::coroutine_handle<> handle, CoroutineExecutor* executor)
+    {
+        if (executor) {
+            executor->post(handle);
+        }
+        else {
+            handle.resume();
+        }
+    }
+};
+
+
+///
+/// Awaitable running several products at once. co_await returns true if all of them completed.
+///
+template<class T>
+class MultiplyGroup
+{
+public:
+    ///
+    /// \brief MultiplyGroup
+    /// \param products The products, they must outlive the group. Their own executors are ignored.
+    /// \param nbProducts Number of products
+    /// \param executor Executor to resume the coroutine on, nullptr to resume it on the worker
+    ///
+    MultiplyGroup(MultiplyAwaitable<T>* products, int nbProducts, CoroutineExecutor* executor = nullptr)
+        : products(products), nbProducts(nbProducts), executor(executor)
+    {
+    }
+
+    bool await_ready() const noexcept
+    {
+        return nbProducts == 0;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        waiter = handle;
+        // One more than the products, so that the coroutine is not resumed before all of them are queued
+        nbPending.store(nbProducts + 1, std::memory_order_relaxed);
+        for (int i = 0; i < nbProducts; ++i) {
+            products[i].group = this;
+            products[i].start();
+        }
+        // If all the products are already over, do not suspend
+        return nbPending.fetch_sub(1, std::memory_order_acq_rel) != 1;
+    }
+
+    bool await_resume() const noexcept
+    {
+        for (int i = 0; i < nbProducts; ++i) {
+            if (!products[i].completed) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+protected:
+    friend class MultiplyAwaitable<T>;
+
+    MultiplyAwaitable<T>* products;
+    int nbProducts;
+    CoroutineExecutor* executor;
+    std::coroutine_handle<> waiter;
+    std::atomic<int> nbPending{0};
+
+    void productDone()
+    {
+        if (nbPending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            MultiplyAwaitable<T>::resume(waiter, executor);
+        }
+    }
+};
+
+
+///
+/// \brief Returns an awaitable computing C = A * B, see MultiplyAwaitable
+///
+template<class T>
+MultiplyAwaitable<T> multiplyAsync(ThreadedMatrixMultiplier<T>& multiplier, const SquareMatrix<T>& A,
+                                   const SquareMatrix<T>& B, SquareMatrix<T>& C, int nbBlocksPerRow,
+                                   CoroutineExecutor* executor = nullptr)
+{
+    return MultiplyAwaitable<T>(multiplier, A, B, C, nbBlocksPerRow, executor);
+}
+
+///
+/// \brief Returns an awaitable running all the products of a vector, see MultiplyGroup
+///
+template<class T>
+MultiplyGroup<T> whenAll(std::vector<MultiplyAwaitable<T>>& products, CoroutineExecutor* executor = nullptr)
+{
+    return MultiplyGroup<T>(products.data(), static_cast<int>(products.size()), executor);
+}
+
+#endif // MULTIPLYAWAITABLE_H
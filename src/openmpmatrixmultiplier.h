@@ -0,0 +1,77 @@
+#ifndef OPENMPMATRIXMULTIPLIER_H
+#define OPENMPMATRIXMULTIPLIER_H
+
+///
+/// Matrix multiplication scheduled by OpenMP
+/// =========================================
+///
+/// Computes the same blocks with the same kernel as ThreadedMatrixMultiplier, but lets the OpenMP runtime
+/// hand them out to its own threads, which an application already using OpenMP shares with the product.
+/// Without OpenMP support from the compiler, the blocks are computed by the calling thread.
+///
+
+#include "abstractmatrixmultiplier.h"
+#include "matrix.h"
+#include "tilekernels.h"
+
+
+template<class T>
+class OpenMPMatrixMultiplier : public AbstractMatrixMultiplier<T>
+{
+public:
+    ///
+    /// \brief OpenMPMatrixMultiplier
+    /// \param nbThreads Number of threads of the parallel regions
+    /// \param nbBlocksPerRow Default number of blocks per row, for compatibility with SimpleMatrixMultiplier
+    ///
+    /// No thread is started here, the OpenMP runtime keeps its own pool.
+    ///
+    OpenMPMatrixMultiplier(int nbThreads, int nbBlocksPerRow = 0)
+        : nbThreads(nbThreads), nbBlocksPerRow(nbBlocksPerRow)
+    {
+    }
+
+    ///
+    /// \brief multiply
+    /// \param A First matrix
+    /// \param B Second matrix
+    /// \param C Result of AxB
+    ///
+    /// For compatibility reason with SimpleMatrixMultiplier
+    void multiply(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C) override
+    {
+        multiply(A, B, C, nbBlocksPerRow);
+    }
+
+    ///
+    /// \brief multiply
+    /// \param A First matrix
+    /// \param B Second matrix
+    /// \param C Result of AxB
+    /// \param nbBlocksPerRow Number of blocks per row (or columns)
+    ///
+    /// The blocks are handed out one by one to the threads of the region, as they become free.
+    /// nbBlocksPerRow must divide the size of the matrix.
+    ///
+    void multiply(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C, int nbBlocksPerRow)
+    {
+        int totalBlocks = nbBlocksPerRow * nbBlocksPerRow;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(nbThreads)
+#endif
+        for (int block = 0; block < totalBlocks; ++block) {
+            computeTile(A, B, C, nbBlocksPerRow, block / nbBlocksPerRow, block % nbBlocksPerRow);
+        }
+    }
+
+    int getThreadCount() const
+    {
+        return nbThreads;
+    }
+
+protected:
+    int nbThreads;
+    int nbBlocksPerRow;
+};
+
+#endif // OPENMPMATRIXMULTIPLIER_H
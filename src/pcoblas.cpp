@@ -0,0 +1,162 @@
+///
+/// BLAS Interface, see pcoblas.h
+///
+/// Each element type has its own engine, running on the process-wide SharedWorkerPool. The arguments are
+/// checked as the reference BLAS does, an illegal one is reported on stderr and the call does nothing.
+///
+
+#include "pcoblas.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "gemm.h"
+
+
+namespace {
+
+template<class T>
+ThreadedMatrixMultiplier<T>& engine()
+{
+    static ThreadedMatrixMultiplier<T> multiplier(SharedWorkerPool::instance());
+    return multiplier;
+}
+
+///
+/// \brief Reports an illegal argument like the xerbla routine of the reference BLAS
+///
+void reportIllegalValue(const char* routine, int parameter)
+{
+    std::fprintf(stderr, " ** On entry to %s parameter number %d had an illegal value\n", routine, parameter);
+}
+
+///
+/// \brief Decodes a Fortran transpose flag
+/// \return false if the flag is invalid
+///
+bool decodeTranspose(char flag, bool& transpose)
+{
+    switch (flag) {
+    case 'N': case 'n':
+        transpose = false;
+        return true;
+    case 'T': case 't': case 'C': case 'c':
+        // Conjugate transpose is the transpose for real matrices
+        transpose = true;
+        return true;
+    default:
+        return false;
+    }
+}
+
+///
+/// \brief Checks the arguments of a column-major gemm and runs it
+///
+template<class T>
+void checkedGemm(const char* routine, char transa, char transb, int m, int n, int k, T alpha, const T* a, int lda,
+                 const T* b, int ldb, T beta, T* c, int ldc)
+{
+    bool transA;
+    bool transB;
+    int info = 0;
+    if (!decodeTranspose(transa, transA)) {
+        info = 1;
+    }
+    else if (!decodeTranspose(transb, transB)) {
+        info = 2;
+    }
+    else if (m < 0) {
+        info = 3;
+    }
+    else if (n < 0) {
+        info = 4;
+    }
+    else if (k < 0) {
+        info = 5;
+    }
+    else if (lda < std::max(1, transA ? k : m)) {
+        info = 8;
+    }
+    else if (ldb < std::max(1, transB ? n : k)) {
+        info = 10;
+    }
+    else if (ldc < std::max(1, m)) {
+        info = 13;
+    }
+    if (info != 0) {
+        reportIllegalValue(routine, info);
+        return;
+    }
+    // Quick return, as the reference BLAS
+    if (m == 0 || n == 0 || ((alpha == T(0) || k == 0) && beta == T(1))) {
+        return;
+    }
+    gemm(engine<T>(), transA, transB, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+}
+
+char transposeFlag(CBLAS_TRANSPOSE transpose)
+{
+    switch (transpose) {
+    case CblasNoTrans:
+        return 'N';
+    case CblasTrans:
+        return 'T';
+    case CblasConjTrans:
+        return 'C';
+    }
+    return '?';
+}
+
+///
+/// \brief Runs a CBLAS gemm, a row-major product being the column-major product of the transposes
+///
+template<class T>
+void cblasGemm(const char* routine, CBLAS_LAYOUT layout, CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB, int m,
+               int n, int k, T alpha, const T* a, int lda, const T* b, int ldb, T beta, T* c, int ldc)
+{
+    if (layout == CblasColMajor) {
+        checkedGemm(routine, transposeFlag(transA), transposeFlag(transB), m, n, k, alpha, a, lda, b, ldb, beta,
+                    c, ldc);
+    }
+    else if (layout == CblasRowMajor) {
+        // C^T = op(B)^T * op(A)^T
+        checkedGemm(routine, transposeFlag(transB), transposeFlag(transA), n, m, k, alpha, b, ldb, a, lda, beta,
+                    c, ldc);
+    }
+    else {
+        reportIllegalValue(routine, 1);
+    }
+}
+
+} // namespace
+
+
+extern "C" {
+
+void sgemm_(const char* transa, const char* transb, const int* m, const int* n, const int* k, const float* alpha,
+            const float* a, const int* lda, const float* b, const int* ldb, const float* beta, float* c,
+            const int* ldc)
+{
+    checkedGemm("SGEMM ", *transa, *transb, *m, *n, *k, *alpha, a, *lda, b, *ldb, *beta, c, *ldc);
+}
+
+void dgemm_(const char* transa, const char* transb, const int* m, const int* n, const int* k, const double* alpha,
+            const double* a, const int* lda, const double* b, const int* ldb, const double* beta, double* c,
+            const int* ldc)
+{
+    checkedGemm("DGEMM ", *transa, *transb, *m, *n, *k, *alpha, a, *lda, b, *ldb, *beta, c, *ldc);
+}
+
+void cblas_sgemm(CBLAS_LAYOUT layout, CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB, int m, int n, int k,
+                 float alpha, const float* a, int lda, const float* b, int ldb, float beta, float* c, int ldc)
+{
+    cblasGemm("cblas_sgemm", layout, transA, transB, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+}
+
+void cblas_dgemm(CBLAS_LAYOUT layout, CBLAS_TRANSPOSE transA, CBLAS_TRANSPOSE transB, int m, int n, int k,
+                 double alpha, const double* a, int lda, const double* b, int ldb, double beta, double* c, int ldc)
+{
+    cblasGemm("cblas_dgemm", layout, transA, transB, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+}
+
+} // extern "C"
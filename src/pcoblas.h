@@ -0,0 +1,41 @@
+#ifndef PCOBLAS_H
+#define PCOBLAS_H
+
+///
+/// BLAS Interface
+/// ==============
+///
+/// The gemm entry points of the Fortran BLAS and of CBLAS, computed by the threaded engine. The shared
+/// library pcoblas exports them, so that a program linked against a reference BLAS can use the engine by
+/// relinking or with LD_PRELOAD=libpcoblas.so, without any change.
+///
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef CBLAS_H
+enum CBLAS_ORDER { CblasRowMajor = 101, CblasColMajor = 102 };
+enum CBLAS_TRANSPOSE { CblasNoTrans = 111, CblasTrans = 112, CblasConjTrans = 113 };
+typedef enum CBLAS_ORDER CBLAS_LAYOUT;
+#endif
+
+void sgemm_(const char* transa, const char* transb, const int* m, const int* n, const int* k, const float* alpha,
+            const float* a, const int* lda, const float* b, const int* ldb, const float* beta, float* c,
+            const int* ldc);
+
+void dgemm_(const char* transa, const char* transb, const int* m, const int* n, const int* k, const double* alpha,
+            const double* a, const int* lda, const double* b, const int* ldb, const double* beta, double* c,
+            const int* ldc);
+
+void cblas_sgemm(CBLAS_LAYOUT layout, enum CBLAS_TRANSPOSE transA, enum CBLAS_TRANSPOSE transB, int m, int n, int k,
+                 float alpha, const float* a, int lda, const float* b, int ldb, float beta, float* c, int ldc);
+
+void cblas_dgemm(CBLAS_LAYOUT layout, enum CBLAS_TRANSPOSE transA, enum CBLAS_TRANSPOSE transB, int m, int n, int k,
+                 double alpha, const double* a, int lda, const double* b, int ldb, double beta, double* c, int ldc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PCOBLAS_H
@@ -0,0 +1,277 @@
+#ifndef SHAREDWORKERPOOL_H
+#define SHAREDWORKERPOOL_H
+
+///
+/// Process-wide Worker Pool
+/// ========================
+///
+/// A set of worker threads that several multipliers, possibly of different element types, submit their jobs
+/// to, so that the whole process runs one thread per core instead of one pool per multiplier.
+///
+/// The pool does not hold the jobs themselves: each client keeps its own queue and only tells the pool how
+/// many jobs it submitted. A worker picks the next client that has pending jobs in a round-robin fashion and
+/// asks it to run one of them, which keeps the clients from starving each other.
+///
+
+#include <pcosynchro/pcohoaremonitor.h>
+#include <pcosynchro/pcothread.h>
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <vector>
+
+
+///
+/// \brief Number of jobs the calling thread is running, nested ones included
+///
+/// A thread running a job must not block waiting for the pool, since the pool may need that very thread.
+///
+inline int& jobNestingDepth()
+{
+    thread_local int depth = 0;
+    return depth;
+}
+
+
+class SharedWorkerPool : protected PcoHoareMonitor
+{
+public:
+    ///
+    /// Interface of the objects submitting jobs to the pool
+    ///
+    class Client
+    {
+    public:
+        ///
+        /// \brief Runs one of the pending jobs of the client, called by the workers of the pool
+        /// \return false if there was no job left to run
+        ///
+        virtual bool runPendingJob() = 0;
+
+        virtual ~Client() = default;
+    };
+
+    ///
+    /// Accounting of the jobs of a client. A job is counted as executed once the worker hands it back to the
+    /// pool, which may be slightly after the client saw it complete.
+    ///
+    struct ClientStats
+    {
+        long long nbSubmitted{0};
+        long long nbExecuted{0};
+    };
+
+    ///
+    /// \brief SharedWorkerPool
+    /// \param nbThreads Number of threads to start
+    ///
+    explicit SharedWorkerPool(int nbThreads = defaultThreadCount())
+        : nextClient(0), nbPendingTotal(0), nbIdleWorkers(0), isTerminating(false)
+    {
+        for (int i = 0; i < std::max(nbThreads, 1); ++i) {
+            threads.push_back(std::make_unique<PcoThread>(&SharedWorkerPool::workerThread, this));
+        }
+    }
+
+    ///
+    /// The pending jobs are dropped, the clients should have unregistered before.
+    /// All threads are joined.
+    ///
+    ~SharedWorkerPool()
+    {
+        monitorIn();
+        isTerminating = true;
+        int nbToWake = nbIdleWorkers;
+        for (int i = 0; i < nbToWake; ++i) {
+            signal(jobAvailable);
+        }
+        monitorOut();
+
+        for (auto& thread : threads) {
+            thread->join();
+        }
+    }
+
+    ///
+    /// \brief Returns the pool shared by the whole process, with one thread per core
+    ///
+    static SharedWorkerPool& instance()
+    {
+        static SharedWorkerPool pool;
+        return pool;
+    }
+
+    ///
+    /// \brief Returns the number of cores of the machine, at least 1
+    ///
+    static int defaultThreadCount()
+    {
+        return std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+    }
+
+    int getThreadCount() const
+    {
+        return static_cast<int>(threads.size());
+    }
+
+    ///
+    /// \brief Makes a client known to the pool, must be called before submitting jobs
+    ///
+    void registerClient(Client* client)
+    {
+        monitorIn();
+        auto record = std::make_unique<ClientRecord>();
+        record->client = client;
+        clients.push_back(std::move(record));
+        monitorOut();
+    }
+
+    ///
+    /// \brief Removes a client from the pool
+    /// \param client The client to remove
+    ///
+    /// Its pending jobs are dropped, and the call returns once no worker is running one of its jobs anymore.
+    ///
+    void unregisterClient(Client* client)
+    {
+        monitorIn();
+        ClientRecord* record = findRecord(client);
+        nbPendingTotal -= record->nbPending;
+        record->nbPending = 0;
+        record->isLeaving = true;
+        while (record->nbRunning > 0) {
+            wait(record->noJobRunning);
+        }
+        auto it = std::find_if(clients.begin(), clients.end(), [&](const auto& r) { return r.get() == record; });
+        size_t index = static_cast<size_t>(it - clients.begin());
+        clients.erase(it);
+        if (nextClient > index) {
+            nextClient--;
+        }
+        monitorOut();
+    }
+
+    ///
+    /// \brief Announces that a client queued new jobs
+    /// \param client The client owning the jobs
+    /// \param nbJobs Number of jobs queued by the client
+    ///
+    void submit(Client* client, int nbJobs)
+    {
+        monitorIn();
+        ClientRecord* record = findRecord(client);
+        record->nbPending += nbJobs;
+        record->stats.nbSubmitted += nbJobs;
+        nbPendingTotal += nbJobs;
+        int nbToWake = std::min(nbJobs, nbIdleWorkers);
+        for (int i = 0; i < nbToWake; ++i) {
+            signal(jobAvailable);
+        }
+        monitorOut();
+    }
+
+    ///
+    /// \brief Returns the accounting of a registered client
+    ///
+    ClientStats getStats(Client* client)
+    {
+        monitorIn();
+        ClientStats stats = findRecord(client)->stats;
+        monitorOut();
+        return stats;
+    }
+
+protected:
+    struct ClientRecord
+    {
+        Client* client{nullptr};
+        int nbPending{0};           // Jobs submitted and not yet taken by a worker
+        int nbRunning{0};           // Jobs currently run by a worker
+        bool isLeaving{false};
+        ClientStats stats;
+        PcoHoareMonitor::Condition noJobRunning;
+    };
+
+    std::vector<std::unique_ptr<ClientRecord>> clients;
+    size_t nextClient;  // Where the round-robin starts looking for pending jobs
+    int nbPendingTotal;
+    int nbIdleWorkers;
+    bool isTerminating;
+    PcoHoareMonitor::Condition jobAvailable;
+    std::vector<std::unique_ptr<PcoThread>> threads;
+
+    ClientRecord* findRecord(Client* client)
+    {
+        for (auto& record : clients) {
+            if (record->client == client) {
+                return record.get();
+            }
+        }
+        return nullptr;
+    }
+
+    ///
+    /// \brief Waits for a pending job and reserves it
+    /// \return The client owning the job, nullptr when terminating
+    ///
+    ClientRecord* acquireJob()
+    {
+        monitorIn();
+        while (nbPendingTotal == 0 && !isTerminating) {
+            nbIdleWorkers++;
+            wait(jobAvailable);
+            nbIdleWorkers--;
+        }
+        if (isTerminating) {
+            monitorOut();
+            return nullptr;
+        }
+
+        // Round-robin over the clients, one job at a time
+        ClientRecord* record = nullptr;
+        for (size_t i = 0; i < clients.size(); ++i) {
+            size_t index = (nextClient + i) % clients.size();
+            if (clients[index]->nbPending > 0) {
+                record = clients[index].get();
+                nextClient = index + 1;
+                break;
+            }
+        }
+        record->nbPending--;
+        record->nbRunning++;
+        nbPendingTotal--;
+        monitorOut();
+        return record;
+    }
+
+    ///
+    /// \brief Releases a job reserved by acquireJob()
+    /// \param record The client owning the job
+    /// \param executed true if the client actually ran a job
+    ///
+    void releaseJob(ClientRecord* record, bool executed)
+    {
+        monitorIn();
+        record->nbRunning--;
+        if (executed) {
+            record->stats.nbExecuted++;
+        }
+        if (record->isLeaving && record->nbRunning == 0) {
+            signal(record->noJobRunning);
+        }
+        monitorOut();
+    }
+
+    void workerThread()
+    {
+        while (ClientRecord* record = acquireJob()) {
+            jobNestingDepth()++;
+            bool executed = record->client->runPendingJob();
+            jobNestingDepth()--;
+            releaseJob(record, executed);
+        }
+    }
+};
+
+#endif // SHAREDWORKERPOOL_H
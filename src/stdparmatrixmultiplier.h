@@ -0,0 +1,87 @@
+#ifndef STDPARMATRIXMULTIPLIER_H
+#define STDPARMATRIXMULTIPLIER_H
+
+///
+/// Matrix multiplication scheduled by the parallel algorithms of the standard library
+/// ==================================================================================
+///
+/// Computes the same blocks with the same kernel as ThreadedMatrixMultiplier, through
+/// std::for_each(std::execution::par, ...). The standard library runtime (TBB with libstdc++) chooses the
+/// threads, so the number of threads given to the constructor is only informative. Without parallel
+/// algorithms in the standard library, the blocks are computed by the calling thread.
+///
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+#if __has_include(<execution>)
+#include <execution>
+#endif
+
+#include "abstractmatrixmultiplier.h"
+#include "matrix.h"
+#include "tilekernels.h"
+
+
+template<class T>
+class StdParMatrixMultiplier : public AbstractMatrixMultiplier<T>
+{
+public:
+    ///
+    /// \brief StdParMatrixMultiplier
+    /// \param nbThreads Number of threads expected, the runtime decides
+    /// \param nbBlocksPerRow Default number of blocks per row, for compatibility with SimpleMatrixMultiplier
+    ///
+    StdParMatrixMultiplier(int nbThreads, int nbBlocksPerRow = 0)
+        : nbThreads(nbThreads), nbBlocksPerRow(nbBlocksPerRow)
+    {
+    }
+
+    ///
+    /// \brief multiply
+    /// \param A First matrix
+    /// \param B Second matrix
+    /// \param C Result of AxB
+    ///
+    /// For compatibility reason with SimpleMatrixMultiplier
+    void multiply(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C) override
+    {
+        multiply(A, B, C, nbBlocksPerRow);
+    }
+
+    ///
+    /// \brief multiply
+    /// \param A First matrix
+    /// \param B Second matrix
+    /// \param C Result of AxB
+    /// \param nbBlocksPerRow Number of blocks per row (or columns)
+    ///
+    /// nbBlocksPerRow must divide the size of the matrix.
+    ///
+    void multiply(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C, int nbBlocksPerRow)
+    {
+        // The parallel algorithms need forward iterators, so the block indices are materialized. A local
+        // vector keeps multiply() reentrant, its size is negligible next to the matrices.
+        std::vector<int> blocks(nbBlocksPerRow * nbBlocksPerRow);
+        std::iota(blocks.begin(), blocks.end(), 0);
+        auto computeBlock = [&](int block) {
+            computeTile(A, B, C, nbBlocksPerRow, block / nbBlocksPerRow, block % nbBlocksPerRow);
+        };
+#if defined(__cpp_lib_execution) && __cpp_lib_execution >= 201603L
+        std::for_each(std::execution::par, blocks.begin(), blocks.end(), computeBlock);
+#else
+        std::for_each(blocks.begin(), blocks.end(), computeBlock);
+#endif
+    }
+
+    int getThreadCount() const
+    {
+        return nbThreads;
+    }
+
+protected:
+    int nbThreads;
+    int nbBlocksPerRow;
+};
+
+#endif // STDPARMATRIXMULTIPLIER_H
@@ -18,7 +18,21 @@
 /// - Each job computes one complete block C[i][j] = Σ A[i][k] * B[k][j]
 /// - No race conditions since each block is written by only one thread
 /// - Computation IDs enable multiple concurrent multiply() calls (reentrancy)
+/// - Computations live in reusable slots, so dispatching a computation does not allocate
 /// - Thread pool is created once in constructor and reused across computations
+/// - The pool can be resized at runtime, explicitly or by an automatic policy
+/// - Alternatively, the jobs can be run by a SharedWorkerPool common to several multipliers
+/// - Idle workers may spin for a while before parking, to pick up new jobs with a lower latency
+/// - Tiny blocks, of the same or of different computations, are handed out together to cut the dispatch overhead
+/// - Computations with a deadline are scheduled earliest-deadline-first and may be cancelled
+/// - multiply() may be called from a worker: the nested caller computes its own blocks instead of sleeping
+/// - A product may read the results of products still running, each of its blocks is queued once the
+///   panels it reads are computed
+/// - A product may run without any thread waiting for it, a callback or a coroutine (multiplyawaitable.h)
+///   being resumed once it is over
+/// - The blocks may be handed over to a consumer as they are computed (tilestream.h)
+/// - The computed blocks may be checkpointed to a file, to resume a product after a crash
+///   (checkpointedmultiply.h)
 ///
 
 #include <pcosynchro/pcoconditionvariable.h>
@@ -27,16 +41,33 @@
 #include <pcosynchro/pcosemaphore.h>
 #include <pcosynchro/pcothread.h>
 
-#include <queue>
-#include <map>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
 #include <memory>
+#include <thread>
+#include <vector>
 
 #include "abstractmatrixmultiplier.h"
 #include "matrix.h"
+#include "sharedworkerpool.h"
+#include "tilekernels.h"
 
 
 ///
-/// A class that holds the necessary parameters for a thread to do a job.
+/// Function called as each block of C is computed, with the indices of the block
+///
+struct TileCallback
+{
+    void (*function)(void* context, int blockI, int blockJ){nullptr};
+    void* context{nullptr};
+};
+
+
+///
+/// A class that holds the parameters shared by all the jobs of a computation, i.e. of one multiply() call.
 ///
 template<class T>
 class ComputeParameters
@@ -46,22 +77,124 @@ public:
     const SquareMatrix<T>* B{nullptr};
     SquareMatrix<T>* C{nullptr};
     
-    // Block indices (i, j) representing which block of C to compute
-    int blockI{0};
-    int blockJ{0};
-    
     // Number of blocks per row/column
     int nbBlocksPerRow{0};
     
     // Computation ID to track which multiply() call this belongs to
     int computationId{0};
+    
+    // The queued computations are served earliest deadline first, the ones without deadline last
+    std::chrono::steady_clock::time_point deadline{std::chrono::steady_clock::time_point::max()};
+    
+    // If set, computes the blocks instead of the square product of A and B, which are then unused
+    void (*tileKernel)(void* context, int blockI, int blockJ){nullptr};
+    void* kernelContext{nullptr};
+    long long tileWork{0}; // Multiply-adds of one block of tileKernel
+    
+    // If set, C += A * B instead of C = A * B
+    bool accumulate{false};
+    
+    // If set, called by the worker right after each block is computed
+    TileCallback onTileDone;
+    
+    // If set, the jobs are only the blocks listed, as row-major indices, rather than all the blocks
+    const int* selectedTiles{nullptr};
+    
+    // If set, the blocks are computed by computeTileDeterministic()
+    bool deterministic{false};
+};
+
+
+///
+/// Outcome of a multiplication with a deadline
+///
+enum class MultiplyStatus
+{
+    Completed,  // C holds A * B
+    TimedOut    // The deadline passed, the remaining blocks were cancelled and C is incomplete
+};
+
+
+///
+/// Function called once a computation is over, instead of waking a waiting caller
+///
+struct CompletionCallback
+{
+    void (*function)(void* context, bool completed){nullptr};  // completed is false if blocks were dropped
+    void* context{nullptr};
+};
+
+
+///
+/// A job: one block of C to compute. It only refers to the parameters of its computation, which stay valid
+/// until the computation is over.
+///
+template<class T>
+struct TileJob
+{
+    const ComputeParameters<T>* computation{nullptr};
+    
+    // Block indices (i, j) representing which block of C to compute
+    int blockI{0};
+    int blockJ{0};
+};
+
+
+///
+/// How a worker waits for a job when the queue is empty. It first checks the queue nbSpins times with a pause
+/// instruction in between, then yields its core nbYields times, and only then parks in the monitor.
+/// Spinning avoids a full sleep and wake up cycle when jobs arrive at a fast pace, at the cost of CPU time.
+///
+struct IdleStrategy
+{
+    int nbSpins{0};
+    int nbYields{0};
+
+    //! Parks right away, the behaviour with the smallest CPU usage
+    static IdleStrategy park() { return {0, 0}; }
+
+    //! Spins a few microseconds then yields before parking
+    static IdleStrategy spinThenPark() { return {4000, 64}; }
+};
+
+///
+/// \brief Hints the CPU that we are in a spin loop
+///
+inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#endif
+}
+
+
+///
+/// Snapshot of the job queue of a multiplier, for monitoring and load shedding
+///
+struct QueueMetrics
+{
+    int nbQueuedJobs{0};          // Blocks waiting for a worker
+    long long nbQueuedWork{0};    // Multiply-adds of these blocks
+    int maxQueuedJobs{0};         // Capacity in blocks, 0 when unbounded
+    long long maxQueuedWork{0};   // Capacity in multiply-adds, 0 when unbounded
+    int nbBusyJobs{0};            // Blocks being computed
+    int nbWaitingSubmitters{0};   // Callers blocked until the queue has room
+    long long nbAdmitted{0};      // Computations queued so far
+    long long nbRejected{0};      // Computations refused by tryMultiply() or multiplyFor()
 };
 
 
-/// As a suggestion, a buffer class that could be used to communicate between
-/// the workers and the main thread...
+/// Buffer used to communicate between the workers and the threads calling multiply().
+///
+/// Each running computation owns a slot holding its parameters and its counters. The slots are kept between
+/// computations and the jobs are not stored one by one: a computation with pending jobs sits in a FIFO list of
+/// slots, and a worker takes the next block of the first slot. Once warmed up, dispatching a computation does
+/// not allocate.
 ///
-/// Here we only wrote two potential methods, but there could be more at the end...
+/// A dependent computation has its blocks released by its producers: its slot lists them in the order their
+/// inputs became ready, and only the released ones can be handed out.
 ///
 template<class T>
 class Buffer : protected PcoHoareMonitor
@@ -69,225 +202,1655 @@ class Buffer : protected PcoHoareMonitor
 public:
     int nbJobFinished{0}; // Keep this updated (for compatibility)
     
-    Buffer() : isTerminating(false), nextComputationId(0) {}
+    ///
+    /// \brief Buffer
+    /// \param nbPreallocatedSlots Number of concurrent computations supported before allocating more slots
+    ///
+    explicit Buffer(int nbPreallocatedSlots = 16)
+        : isTerminating(false), nbWorkersWanted(0), nbIdleWorkers(0), nbRunningJobs(0),
+          lastSaturated(std::chrono::steady_clock::now())
+    {
+        freeSlots.reserve(nbPreallocatedSlots);
+        for (int i = 0; i < nbPreallocatedSlots; ++i) {
+            slots.emplace_back();
+            freeSlots.push_back(nbPreallocatedSlots - 1 - i);
+        }
+    }
     
     ///
-    /// \brief Sends a job to the buffer
-    /// \param params Reference to a ComputeParameters object which holds the necessary parameters to execute a job
+    /// \brief Starts a new computation and makes its jobs available to the workers
+    /// \param params Parameters shared by all the jobs, its computationId is set by the buffer
+    /// \param totalJobs Total number of jobs (blocks of C) of this computation
+    /// \return The computation ID
+    ///
+    /// If the queue is bounded, waits until it has room for the jobs of the computation, unless the caller
+    /// is itself running a job: all the workers could otherwise end up waiting for each other.
+    ///
+    int startNewComputation(const ComputeParameters<T>& params, int totalJobs) {
+        monitorIn();
+        long long work = jobWork(params) * totalJobs;
+        while (jobNestingDepth() == 0 && !hasRoomFor(totalJobs, work)) {
+            nbWaitingSubmitters++;
+            wait(spaceAvailable);
+            nbWaitingSubmitters--;
+        }
+        int id = enqueueComputation(params, totalJobs);
+        // Room may be left for the next submitter
+        if (nbWaitingSubmitters > 0 && !isTerminating) {
+            signal(spaceAvailable);
+        }
+        monitorOut();
+        return id;
+    }
+
+    ///
+    /// \brief Starts a new computation that nobody waits for, a callback is run once it is over
+    /// \param params Parameters shared by all the jobs, its computationId is set by the buffer
+    /// \param totalJobs Total number of jobs (blocks of C) of this computation
+    /// \param onDone Called outside of the monitor by the thread finishing the last job, after the slot
+    ///        of the computation is released
+    /// \return The computation ID, valid until onDone is called
+    ///
+    /// The caller is not blocked, so the capacity of the queue is not checked either.
+    ///
+    int startNewComputation(const ComputeParameters<T>& params, int totalJobs, const CompletionCallback& onDone) {
+        monitorIn();
+        int id = enqueueComputation(params, totalJobs, onDone);
+        if (totalJobs == 0) {
+            computationFinished(id);
+        }
+        leaveMonitor();
+        return id;
+    }
+
+    ///
+    /// \brief Starts a new computation only if the queue has room for its jobs right now
+    /// \param params Parameters shared by all the jobs, its computationId is set by the buffer
+    /// \param totalJobs Total number of jobs (blocks of C) of this computation
+    /// \param computationId Set to the computation ID on success
+    /// \return true if the computation was started, false if it was rejected
+    ///
+    bool tryStartNewComputation(const ComputeParameters<T>& params, int totalJobs, int& computationId) {
+        monitorIn();
+        // Do not overtake the submitters already waiting for room
+        bool admitted = nbWaitingSubmitters == 0 && hasRoomFor(totalJobs, jobWork(params) * totalJobs);
+        if (admitted) {
+            computationId = enqueueComputation(params, totalJobs);
+        }
+        monitorOut();
+        return admitted;
+    }
+
+    ///
+    /// \brief Starts a computation whose operands are, in part, the results of computations still running
+    /// \param params Parameters shared by all the jobs, its computationId is set by the buffer
+    /// \param totalJobs Total number of jobs (blocks of C) of this computation
+    /// \param producerId ID of a computation whose C is params.A and/or params.B
+    /// \param otherProducerId ID of a second such computation, or -1
+    /// \return The computation ID
+    ///
+    /// Instead of waiting for the producers to complete, each block (i, j) is queued as soon as the row
+    /// panel i of the producer of A and the column panel j of the producer of B are computed, so that the
+    /// two stages overlap. A producer with a different number of blocks per row feeds all the blocks at
+    /// once when it completes. The producers must not have been waited for yet.
+    ///
+    /// The blocks enter the queue progressively, so the capacity of the queue is not checked.
+    ///
+    int startDependentComputation(const ComputeParameters<T>& params, int totalJobs, int producerId,
+                                  int otherProducerId = NO_SLOT) {
+        monitorIn();
+        int id = initSlot(params, totalJobs);
+        ComputationSlot& slot = slots[id];
+        nbAdmitted++;
+        slot.hasProducers = true;
+        slot.releasedJobs.resize(totalJobs);
+        slot.nbMissingInputs.assign(totalJobs, 0);
+
+        // Find which operands the producers compute
+        int candidates[2] = {producerId, otherProducerId};
+        bool isAborted = isTerminating;
+        for (int producer : candidates) {
+            if (producer == NO_SLOT) {
+                continue;
+            }
+            bool sameBlocks = slots[producer].params.nbBlocksPerRow == params.nbBlocksPerRow;
+            int kinds[2] = {sameBlocks ? LEFT_INPUT : WHOLE_INPUT, sameBlocks ? RIGHT_INPUT : WHOLE_INPUT};
+            const SquareMatrix<T>* operands[2] = {params.A, params.B};
+            for (int operand = 0; operand < 2; ++operand) {
+                int kind = kinds[operand];
+                if (slots[producer].params.C != operands[operand]) {
+                    continue;
+                }
+                // Each producer with another blocking gets its own whole-input edge, one is enough per producer
+                if (kind == WHOLE_INPUT && slot.producers[WHOLE_INPUT] != NO_SLOT
+                    && slot.producers[WHOLE_INPUT] != producer) {
+                    kind = OTHER_WHOLE_INPUT;
+                }
+                if (slot.producers[kind] != NO_SLOT) {
+                    continue;
+                }
+                isAborted = isAborted || slots[producer].isAborted;
+                // A completed producer has no panel left to wait for
+                if (slots[producer].nbJobsFinished == slots[producer].nbJobs) {
+                    continue;
+                }
+                slot.producers[kind] = producer;
+                slot.nextDependent[kind] = slots[producer].firstDependent;
+                slots[producer].firstDependent = id * NB_INPUT_KINDS + kind;
+            }
+        }
+
+        if (isAborted) {
+            abortPendingJobs(id);
+        }
+        else {
+            // Each block waits for one panel per producer, minus the panels already computed
+            int nbBlocksPerRow = params.nbBlocksPerRow;
+            for (int kind = 0; kind < NB_INPUT_KINDS; ++kind) {
+                if (slot.producers[kind] == NO_SLOT) {
+                    continue;
+                }
+                for (int index = 0; index < totalJobs; ++index) {
+                    slot.nbMissingInputs[index]++;
+                }
+            }
+            for (int index = 0; index < totalJobs; ++index) {
+                if (slot.nbMissingInputs[index] == 0) {
+                    releaseJob(id, index);
+                }
+            }
+            for (int kind = 0; kind < NB_INPUT_KINDS; ++kind) {
+                int producer = slot.producers[kind];
+                int nbPanels = isWholeInput(kind) ? 1 : nbBlocksPerRow;
+                for (int panel = 0; producer != NO_SLOT && panel < nbPanels; ++panel) {
+                    if (isPanelDone(slots[producer], kind, panel)) {
+                        panelReady(id, kind, panel);
+                    }
+                }
+            }
+            publishReleasedJobs();
+        }
+        leaveMonitor();
+        return id;
+    }
+
+    ///
+    /// \brief Sets a function called with the number of blocks of dependent computations each time some are queued
+    /// \param handler The function, called from within the monitor
+    /// \param context Passed to the handler
+    ///
+    /// A SharedWorkerPool is only told about the blocks that can be handed out, so a multiplier running on
+    /// such a pool submits the blocks of its dependent computations through this handler.
     ///
-    void sendJob(ComputeParameters<T> params) {
+    void setJobsReleasedHandler(void (*handler)(void*, int), void* context) {
         monitorIn();
-        jobQueue.push(params);
-        signal(jobAvailable);
+        jobsReleasedHandler = handler;
+        jobsReleasedContext = context;
         monitorOut();
     }
 
     ///
-    /// \brief Requests a job to the buffer
-    /// \param parameters Reference to a ComputeParameters object which holds the necessary parameters to execute a job
-    /// \return true if a job is available, false otherwise (when terminating)
+    /// \brief Requests jobs to the buffer
+    /// \param jobs Filled with the blocks to compute
+    /// \param maxJobs Capacity of jobs
+    /// \param workerId Index of the calling worker in the pool
+    /// \return The number of jobs handed out, 0 when terminating or when the worker is retired
     ///
-    bool getJob(ComputeParameters<T>& parameters) {
+    /// Small blocks are coalesced: following blocks, possibly of the next computations, are added while their
+    /// total work stays within the coalescing budget and the worker does not take more than its share of the
+    /// queued jobs.
+    ///
+    int getJobs(TileJob<T>* jobs, int maxJobs, int workerId) {
+        spinUntilJob();
+        
         monitorIn();
         
-        // Wait while no jobs available and not terminating
-        while (jobQueue.empty() && !isTerminating) {
+        // Wait while no jobs available, not terminating and the worker is still wanted
+        while (nbQueuedJobs == 0 && !isTerminating && workerId < nbWorkersWanted) {
+            nbIdleWorkers++;
+            idleWorkers[workerId] = true;
             wait(jobAvailable);
+            idleWorkers[workerId] = false;
+            nbIdleWorkers--;
         }
         
-        // If terminating and no jobs, return false
-        if (isTerminating && jobQueue.empty()) {
+        // If terminating and no jobs, or if the pool shrank below this worker, return 0
+        if ((isTerminating && nbQueuedJobs == 0) || workerId >= nbWorkersWanted) {
+            // We may have consumed a signal meant for a job, pass it on
+            if (nbQueuedJobs > 0) {
+                signal(jobAvailable);
+            }
             monitorOut();
-            return false;
+            return 0;
         }
         
-        // Get job from queue
-        parameters = jobQueue.front();
-        jobQueue.pop();
+        int share = (nbQueuedJobs + nbWorkersWanted - 1) / nbWorkersWanted;
+        int nbJobs = 0;
+        long long work = 0;
+        do {
+            work += slots[firstReady].jobWork;
+            takeJob(jobs[nbJobs++]);
+        } while (nbJobs < maxJobs && nbJobs < share && nbQueuedJobs > 0
+                 && work + slots[firstReady].jobWork <= coalescingBudget);
+        
+        if (nbIdleWorkers == 0) {
+            lastSaturated = std::chrono::steady_clock::now();
+        }
+        notifySpaceAvailable();
         
         monitorOut();
-        return true;
+        return nbJobs;
     }
     
     ///
-    /// \brief Signals that a job has been completed
-    /// \param computationId The ID of the computation this job belongs to
+    /// \brief Takes a job from the buffer without waiting, for the workers of a SharedWorkerPool
+    /// \param job Filled with the block to compute
+    /// \return true if a job was available
     ///
-    void jobCompleted(int computationId) {
+    bool tryGetJob(TileJob<T>& job) {
         monitorIn();
-        nbJobFinished++; // Global counter for compatibility
-        jobsFinishedPerComputation[computationId]++;
-        signal(jobDone);
+        if (nbQueuedJobs == 0) {
+            monitorOut();
+            return false;
+        }
+        takeJob(job);
+        notifySpaceAvailable();
         monitorOut();
+        return true;
     }
     
     ///
-    /// \brief Gets a new computation ID and initializes its counter
-    /// \param totalJobs Total number of jobs for this computation
-    /// \return The computation ID
+    /// \brief Takes a queued job of a given computation without waiting, for a caller helping with its own jobs
+    /// \param computationId The ID of the computation
+    /// \param job Filled with the block to compute
+    /// \return true if the computation had a job that was not handed out yet
     ///
-    int startNewComputation(int totalJobs) {
+    bool tryGetJobOf(int computationId, TileJob<T>& job) {
         monitorIn();
-        int id = nextComputationId++;
-        jobsFinishedPerComputation[id] = 0;
-        totalJobsPerComputation[id] = totalJobs;
+        ComputationSlot& slot = slots[computationId];
+        bool available = slot.nextJob < slot.nbReleased;
+        if (available) {
+            takeJob(job, computationId);
+            notifySpaceAvailable();
+        }
         monitorOut();
-        return id;
+        return available;
+    }
+    
+    ///
+    /// \brief Signals that jobs have been completed
+    /// \param jobs The jobs that were computed, possibly of several computations
+    /// \param nbJobs Number of jobs
+    ///
+    void jobsCompleted(const TileJob<T>* jobs, int nbJobs) {
+        monitorIn();
+        nbJobFinished += nbJobs; // Global counter for compatibility
+        nbRunningJobs -= nbJobs;
+        for (int i = 0; i < nbJobs; ++i) {
+            int id = jobs[i].computation->computationId;
+            ComputationSlot& slot = slots[id];
+            slot.nbJobsFinished++;
+            // Panels are only counted for an unaborted computation, whose dependents still wait for them
+            if (!slot.isAborted) {
+                int nbBlocksPerRow = slot.params.nbBlocksPerRow;
+                if (++slot.nbRowJobsDone[jobs[i].blockI] == nbBlocksPerRow) {
+                    forwardPanel(id, LEFT_INPUT, jobs[i].blockI);
+                }
+                if (++slot.nbColumnJobsDone[jobs[i].blockJ] == nbBlocksPerRow) {
+                    forwardPanel(id, RIGHT_INPUT, jobs[i].blockJ);
+                }
+            }
+            if (slot.nbJobsFinished == slot.nbJobs) {
+                computationFinished(id);
+            }
+        }
+        publishReleasedJobs();
+        leaveMonitor();
+    }
+
+    ///
+    /// \brief Signals that a job has been completed
+    /// \param job The job that was computed
+    ///
+    void jobCompleted(const TileJob<T>& job) {
+        jobsCompleted(&job, 1);
     }
     
     ///
-    /// \brief Waits until all jobs for a specific computation are done
+    /// \brief Waits until all jobs for a specific computation are done, then releases its slot
     /// \param computationId The ID of the computation to wait for
     ///
     void waitAllJobsDone(int computationId) {
         monitorIn();
-        int totalJobs = totalJobsPerComputation[computationId];
-        while (jobsFinishedPerComputation[computationId] < totalJobs) {
-            wait(jobDone);
+        ComputationSlot& slot = slots[computationId];
+        while (slot.nbJobsFinished < slot.nbJobs) {
+            wait(slot.allJobsDone);
         }
         // Cleanup
-        jobsFinishedPerComputation.erase(computationId);
-        totalJobsPerComputation.erase(computationId);
+        freeSlot(computationId);
         monitorOut();
     }
     
     ///
-    /// \brief Signals termination to all worker threads
+    /// \brief Releases the slot of a computation if all its jobs are done, without waiting
+    /// \param computationId The ID of the computation
+    /// \return true if the computation was done, its ID is then no longer valid
     ///
-    void terminate() {
+    bool releaseIfDone(int computationId) {
         monitorIn();
-        isTerminating = true;
-        // We need to wake all waiting threads
-        // Since signal() in Hoare monitors wakes one thread at a time,
-        // and we don't know how many are waiting, we keep the queue non-empty
-        // by pushing dummy jobs, or just rely on the threads checking isTerminating
-        // Actually, let's just use a simple approach: don't use signal here
-        // The threads will check isTerminating when they next call getJob()
-        // But some threads might be blocked in wait(). We need to signal them.
-        // In a proper implementation, we'd use broadcast or signal in a loop
+        ComputationSlot& slot = slots[computationId];
+        bool done = slot.nbJobsFinished == slot.nbJobs;
+        if (done) {
+            freeSlot(computationId);
+        }
         monitorOut();
-        
-        // Push dummy jobs to wake threads (they'll check isTerminating and exit)
-        for (int i = 0; i < 100; ++i) {  // More than enough to wake all possible threads
-            monitorIn();
-            signal(jobAvailable);
-            monitorOut();
+        return done;
+    }
+    
+    ///
+    /// \brief Cancels the queued jobs of a computation, waits for its running ones and releases its slot
+    /// \param computationId The ID of the computation
+    /// \return true if some jobs were cancelled, false if the computation had all its jobs handed out
+    ///
+    /// The computations depending on it are cancelled as well, but their slots are left to their own callers.
+    ///
+    bool cancelComputation(int computationId) {
+        monitorIn();
+        ComputationSlot& slot = slots[computationId];
+        int nbCancelled = abortPendingJobs(computationId);
+        if (nbCancelled > 0) {
+            notifySpaceAvailable();
         }
+        while (slot.nbJobsFinished < slot.nbJobs) {
+            wait(slot.allJobsDone);
+        }
+        freeSlot(computationId);
+        leaveMonitor();
+        return nbCancelled > 0;
+    }
+    
+    ///
+    /// \brief Sets the number of workers allowed to take jobs
+    /// \param nbWorkers Workers with an index greater or equal to nbWorkers retire before their next job
+    ///
+    void setWorkerCount(int nbWorkers) {
+        monitorIn();
+        bool shrinking = nbWorkers < nbWorkersWanted;
+        nbWorkersWanted = nbWorkers;
+        if (nbWorkers > static_cast<int>(idleWorkers.size())) {
+            idleWorkers.resize(nbWorkers, false);
+        }
+        if (shrinking) {
+            // The retired workers leave once woken, the others wait again. A worker waiting again may get the
+            // next signal as well, so wake until no retired worker is left rather than once per idle worker.
+            while (hasIdleRetiredWorker()) {
+                signal(jobAvailable);
+            }
+        }
+        monitorOut();
     }
 
-private:
-    std::queue<ComputeParameters<T>> jobQueue;
-    std::map<int, int> jobsFinishedPerComputation; // Track finished jobs per computation
-    std::map<int, int> totalJobsPerComputation;     // Track total jobs per computation
-    int nextComputationId;
-    PcoHoareMonitor::Condition jobAvailable;
-    PcoHoareMonitor::Condition jobDone;
-    bool isTerminating;
-};
-
-
+    ///
+    /// \brief Bounds the number of queued jobs
+    /// \param maxJobs Maximal number of queued blocks, 0 for no limit
+    /// \param maxWork Maximal number of multiply-adds of the queued blocks, 0 for no limit
+    ///
+    /// A computation is admitted when all its blocks fit, or when the queue is empty.
+    ///
+    void setQueueCapacity(int maxJobs, long long maxWork = 0) {
+        monitorIn();
+        maxQueuedJobs = maxJobs;
+        maxQueuedWork = maxWork;
+        notifySpaceAvailable();
+        monitorOut();
+    }
 
-///
-/// A multi-threaded multiplicator. multiply() should at least be reentrant.
-/// It is up to you to offer a very good parallelism.
-///
-template<class T>
-class ThreadedMatrixMultiplier : public AbstractMatrixMultiplier<T>
-{
+    ///
+    /// \brief Returns the current state of the queue
+    ///
+    QueueMetrics getQueueMetrics() {
+        monitorIn();
+        QueueMetrics metrics;
+        metrics.nbQueuedJobs = nbQueuedJobs;
+        metrics.nbQueuedWork = nbQueuedWork;
+        metrics.maxQueuedJobs = maxQueuedJobs;
+        metrics.maxQueuedWork = maxQueuedWork;
+        metrics.nbBusyJobs = nbRunningJobs;
+        metrics.nbWaitingSubmitters = nbWaitingSubmitters;
+        metrics.nbAdmitted = nbAdmitted;
+        metrics.nbRejected = nbRejected;
+        monitorOut();
+        return metrics;
+    }
 
-public:
     ///
-    /// \brief ThreadedMatrixMultiplier
-    /// \param nbThreads Number of threads to start
-    /// \param nbBlocksPerRow Default number of blocks per row, for compatibility with SimpleMatrixMultiplier
+    /// \brief Counts a computation that was not admitted
     ///
-    /// The threads shall be started from the constructor
+    void countRejected() {
+        monitorIn();
+        nbRejected++;
+        monitorOut();
+    }
+
     ///
-    ThreadedMatrixMultiplier(int nbThreads, int nbBlocksPerRow = 0)
-        : nbThreads(nbThreads), nbBlocksPerRow(nbBlocksPerRow)
-    {
-        buffer = std::make_unique<Buffer<T>>();
-        
-        // Create and start worker threads
-        for (int i = 0; i < nbThreads; ++i) {
-            threads.push_back(std::make_unique<PcoThread>(&ThreadedMatrixMultiplier::workerThread, this));
-        }
+    /// \brief Sets how much work may be handed out at once to a worker
+    /// \param nbMultiplyAdds Maximal number of multiply-adds of coalesced blocks, 0 to hand out one block at a time
+    ///
+    void setCoalescingBudget(long long nbMultiplyAdds) {
+        monitorIn();
+        coalescingBudget = nbMultiplyAdds;
+        monitorOut();
     }
 
     ///
-    /// In this destructor we should ask for the termination of the computations. They could be aborted without
-    /// ending into completion.
-    /// All threads have to be joined.
+    /// \brief Changes the way idle workers wait for jobs
     ///
-    ~ThreadedMatrixMultiplier()
-    {
-        // Signal termination to all threads
-        buffer->terminate();
-        
-        // Wait for all threads to finish
-        for (auto& thread : threads) {
-            thread->join();
-        }
+    void setIdleStrategy(const IdleStrategy& strategy) {
+        nbSpins.store(strategy.nbSpins, std::memory_order_relaxed);
+        nbYields.store(strategy.nbYields, std::memory_order_relaxed);
     }
 
     ///
-    /// \brief multiply
-    /// \param A First matrix
-    /// \param B Second matrix
-    /// \param C Result of AxB
+    /// \brief Gives the current load of the pool
+    /// \param nbQueued Number of jobs waiting in the queue
+    /// \param nbRunning Number of jobs taken from the queue and not completed yet, coalesced ones counted one by one
+    /// \param underusedFor Time elapsed since all workers were last busy at once
     ///
-    /// For compatibility reason with SimpleMatrixMultiplier
-    void multiply(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C) override
-    {
-        multiply(A, B, C, nbBlocksPerRow);
+    void getLoad(int& nbQueued, int& nbRunning, std::chrono::steady_clock::duration& underusedFor) {
+        monitorIn();
+        nbQueued = nbQueuedJobs;
+        nbRunning = nbRunningJobs;
+        if (nbQueued > 0 || nbIdleWorkers == 0) {
+            lastSaturated = std::chrono::steady_clock::now();
+        }
+        underusedFor = std::chrono::steady_clock::now() - lastSaturated;
+        monitorOut();
     }
 
     ///
-    /// \brief multiply
-    /// \param A First matrix
-    /// \param B Second matrix
-    /// \param C Result of AxB
-    /// \param nbBlocksPerRow Number of blocks per row (or columns)
+    /// \brief Signals termination to all worker threads
     ///
-    /// Executes the multithreaded computation, by decomposing the matrices into blocks.
-    /// nbBlocksPerRow must divide the size of the matrix.
+    /// The queued jobs are dropped, the jobs being computed run to completion. The cost is one
+    /// signal per waiting thread. The callbacks of the computations dropped entirely run before returning.
     ///
-    void multiply(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C, int nbBlocksPerRow)
-    {
-        int n = A.size();
-        int blockSize = n / nbBlocksPerRow;
-        int totalBlocks = nbBlocksPerRow * nbBlocksPerRow;
+    void terminate() {
+        monitorIn();
+        isTerminating = true;
         
-        // Initialize result matrix to zero
-        for (int i = 0; i < n; ++i) {
-            for (int j = 0; j < n; ++j) {
-                C.setElement(i, j, 0);
+        // Abort the queued jobs and those waiting for their inputs, they count as finished so that no caller
+        // waits for them
+        for (int id = 0; id < static_cast<int>(slots.size()); ++id) {
+            if (slots[id].inUse) {
+                abortPendingJobs(id);
             }
         }
+        nbQueuedJobs = 0;
+        nbQueuedWork = 0;
+        nbQueuedJobsHint.store(0, std::memory_order_release);
         
-        // Start a new computation and get its ID
-        int computationId = buffer->startNewComputation(totalBlocks);
-        
-        // Create and send all jobs to the buffer
-        for (int blockI = 0; blockI < nbBlocksPerRow; ++blockI) {
-            for (int blockJ = 0; blockJ < nbBlocksPerRow; ++blockJ) {
-                ComputeParameters<T> params;
-                params.A = &A;
-                params.B = &B;
-                params.C = &C;
-                params.blockI = blockI;
-                params.blockJ = blockJ;
-                params.nbBlocksPerRow = nbBlocksPerRow;
-                params.computationId = computationId;
-                
-                buffer->sendJob(params);
-            }
+        // signal() only wakes one thread, so signal once per waiting worker, it sees isTerminating and leaves.
+        // The submitters waiting for room get an aborted computation.
+        int nbToWake = nbIdleWorkers;
+        for (int i = 0; i < nbToWake; ++i) {
+            signal(jobAvailable);
+        }
+        nbToWake = nbWaitingSubmitters;
+        for (int i = 0; i < nbToWake; ++i) {
+            signal(spaceAvailable);
+        }
+        leaveMonitor();
+    }
+
+    //! Work below which blocks are coalesced, around a few tens of microseconds of computation
+    static constexpr long long DEFAULT_COALESCING_BUDGET = 1 << 16;
+
+private:
+    static constexpr int NO_SLOT = -1;
+
+    // How a dependent computation reads the result of a producer
+    static constexpr int LEFT_INPUT = 0;   // As A: block (i, j) needs row panel i
+    static constexpr int RIGHT_INPUT = 1;  // As B: block (i, j) needs column panel j
+    static constexpr int WHOLE_INPUT = 2;  // Different blocking, every block needs the whole result
+    static constexpr int OTHER_WHOLE_INPUT = 3; // The same, for a second producer with a different blocking
+    static constexpr int NB_INPUT_KINDS = 4;
+
+    static bool isWholeInput(int kind) { return kind == WHOLE_INPUT || kind == OTHER_WHOLE_INPUT; }
+
+    ///
+    /// A running computation, or a free slot waiting for the next one
+    ///
+    struct ComputationSlot
+    {
+        ComputeParameters<T> params;
+        int nbJobs{0};
+        int nextJob{0};          // Index of the next block to hand out, row by row
+        int nbJobsFinished{0};
+        long long jobWork{0};    // Multiply-adds needed for one block
+        int nextReady{NO_SLOT};  // Next slot in the list of computations with queued jobs
+        bool inUse{false};
+        bool isAborted{false};   // Some blocks were dropped, C will never be complete
+        PcoHoareMonitor::Condition allJobsDone;
+
+        // Dataflow, the blocks are handed out in the order their inputs became ready
+        int nbReleased{0};                // Blocks whose inputs are ready, nextJob never goes past it
+        bool hasProducers{false};         // Blocks are released by producers, in releasedJobs order
+        std::vector<int> releasedJobs;
+        std::vector<int> nbMissingInputs; // Per block, panels of the producers not computed yet
+        int producers[NB_INPUT_KINDS]{NO_SLOT, NO_SLOT, NO_SLOT, NO_SLOT};
+        int nextDependent[NB_INPUT_KINDS]{NO_SLOT, NO_SLOT, NO_SLOT, NO_SLOT}; // Next edge in the producer's list
+        CompletionCallback onDone;        // Set if nobody waits for the computation
+        int nextFinished{NO_SLOT};        // Next slot in the list of callbacks to run
+        int firstDependent{NO_SLOT};      // Edges (dependent * NB_INPUT_KINDS + kind) of our consumers
+        std::vector<int> nbRowJobsDone;   // Finished blocks per row panel of C
+        std::vector<int> nbColumnJobsDone;
+    };
+    
+    ///
+    /// \brief Returns the index of a free slot, creating one if needed
+    ///
+    int allocateSlot() {
+        if (freeSlots.empty()) {
+            slots.emplace_back();
+            return static_cast<int>(slots.size()) - 1;
+        }
+        int id = freeSlots.back();
+        freeSlots.pop_back();
+        return id;
+    }
+    
+    ///
+    /// \brief Inserts a computation in the list of computations with queued jobs, ordered by deadline
+    ///
+    /// Computations with the same deadline keep their arrival order, so without deadlines the list is a FIFO.
+    ///
+    void pushReady(int id) {
+        auto deadline = slots[id].params.deadline;
+        int previous = NO_SLOT;
+        int next = firstReady;
+        if (lastReady != NO_SLOT && slots[lastReady].params.deadline <= deadline) {
+            // Common case, appended at the end
+            previous = lastReady;
+            next = NO_SLOT;
+        }
+        while (next != NO_SLOT && slots[next].params.deadline <= deadline) {
+            previous = next;
+            next = slots[next].nextReady;
+        }
+        slots[id].nextReady = next;
+        if (previous == NO_SLOT) {
+            firstReady = id;
+        }
+        else {
+            slots[previous].nextReady = id;
+        }
+        if (next == NO_SLOT) {
+            lastReady = id;
+        }
+    }
+    
+    ///
+    /// \brief Removes a computation from the list of computations with queued jobs, if it is in it
+    ///
+    void removeReady(int id) {
+        int previous = NO_SLOT;
+        int current = firstReady;
+        while (current != NO_SLOT && current != id) {
+            previous = current;
+            current = slots[current].nextReady;
+        }
+        if (current == NO_SLOT) {
+            return;
+        }
+        if (previous == NO_SLOT) {
+            firstReady = slots[id].nextReady;
+        }
+        else {
+            slots[previous].nextReady = slots[id].nextReady;
+        }
+        if (lastReady == id) {
+            lastReady = previous;
+        }
+    }
+    
+    void popReady() {
+        firstReady = slots[firstReady].nextReady;
+        if (firstReady == NO_SLOT) {
+            lastReady = NO_SLOT;
+        }
+    }
+    
+    ///
+    /// \brief Hands out the next block of a computation with queued jobs
+    /// \param job Filled with the block to compute
+    /// \param id The computation, by default the first one with queued jobs
+    ///
+    void takeJob(TileJob<T>& job, int id = NO_SLOT) {
+        if (id == NO_SLOT) {
+            id = firstReady;
+        }
+        ComputationSlot& slot = slots[id];
+        int nbBlocksPerRow = slot.params.nbBlocksPerRow;
+        int index = slot.hasProducers ? slot.releasedJobs[slot.nextJob] : slot.nextJob;
+        if (slot.params.selectedTiles) {
+            index = slot.params.selectedTiles[index];
+        }
+        job.computation = &slot.params;
+        job.blockI = index / nbBlocksPerRow;
+        job.blockJ = index % nbBlocksPerRow;
+        slot.nextJob++;
+        if (slot.nextJob == slot.nbReleased) {
+            if (id == firstReady) {
+                popReady();
+            }
+            else {
+                removeReady(id);
+            }
+        }
+        nbQueuedJobs--;
+        nbQueuedWork -= slot.jobWork;
+        nbQueuedJobsHint.store(nbQueuedJobs, std::memory_order_release);
+        nbRunningJobs++;
+    }
+    
+    ///
+    /// \brief Returns the number of multiply-adds needed for one block of a computation
+    ///
+    static long long jobWork(const ComputeParameters<T>& params) {
+        if (params.tileKernel) {
+            return params.tileWork;
+        }
+        long long blockSize = params.A->size() / std::max(params.nbBlocksPerRow, 1);
+        return blockSize * blockSize * params.A->size();
+    }
+    
+    ///
+    /// \brief Tells if a computation may be queued without exceeding the capacity of the queue
+    ///
+    /// An empty queue accepts any computation, so that one larger than the capacity is not blocked forever.
+    ///
+    bool hasRoomFor(int nbJobs, long long work) const {
+        if (isTerminating || nbQueuedJobs == 0) {
+            return true;
+        }
+        return (maxQueuedJobs == 0 || nbQueuedJobs + nbJobs <= maxQueuedJobs)
+               && (maxQueuedWork == 0 || nbQueuedWork + work <= maxQueuedWork);
+    }
+    
+    ///
+    /// \brief Fills a slot for the computation and queues its jobs
+    /// \return The computation ID
+    ///
+    int enqueueComputation(const ComputeParameters<T>& params, int totalJobs,
+                           const CompletionCallback& onDone = CompletionCallback()) {
+        int id = initSlot(params, totalJobs);
+        ComputationSlot& slot = slots[id];
+        slot.onDone = onDone;
+        nbAdmitted++;
+
+        if (isTerminating) {
+            // Nobody will run the jobs anymore
+            abortPendingJobs(id);
+        }
+        else if (totalJobs > 0) {
+            slot.nbReleased = totalJobs;
+            pushReady(id);
+            nbQueuedJobs += totalJobs;
+            nbQueuedWork += slot.jobWork * totalJobs;
+            nbQueuedJobsHint.store(nbQueuedJobs, std::memory_order_release);
+            wakeWorkers();
+        }
+        return id;
+    }
+
+    ///
+    /// \brief Allocates and resets a slot for a computation, without queuing any of its jobs
+    /// \return The computation ID
+    ///
+    int initSlot(const ComputeParameters<T>& params, int totalJobs) {
+        int id = allocateSlot();
+        ComputationSlot& slot = slots[id];
+        slot.params = params;
+        slot.params.computationId = id;
+        slot.nbJobs = totalJobs;
+        slot.nextJob = 0;
+        slot.nbJobsFinished = 0;
+        slot.nbReleased = 0;
+        slot.jobWork = jobWork(params);
+        slot.inUse = true;
+        slot.isAborted = false;
+        slot.hasProducers = false;
+        slot.firstDependent = NO_SLOT;
+        slot.onDone = CompletionCallback();
+        for (int kind = 0; kind < NB_INPUT_KINDS; ++kind) {
+            slot.producers[kind] = NO_SLOT;
+        }
+        // Keeps the capacity, so a reused slot does not allocate
+        slot.nbRowJobsDone.assign(params.nbBlocksPerRow, 0);
+        slot.nbColumnJobsDone.assign(params.nbBlocksPerRow, 0);
+        return id;
+    }
+
+    ///
+    /// \brief Marks a slot as free for the next computation
+    ///
+    void freeSlot(int id) {
+        slots[id].inUse = false;
+        freeSlots.push_back(id);
+    }
+
+    ///
+    /// \brief Wakes parked workers for the queued jobs
+    ///
+    /// Each spinning worker will take one of the queued jobs, only wake parked ones for the others.
+    /// A woken worker takes a job before we resume, so the loop ends.
+    ///
+    void wakeWorkers() {
+        while (nbIdleWorkers > 0 && nbQueuedJobs > nbSpinningWorkers.load(std::memory_order_acquire)) {
+            signal(jobAvailable);
+        }
+    }
+
+    ///
+    /// \brief Tells if all the blocks of a panel of a computation are computed
+    ///
+    bool isPanelDone(const ComputationSlot& producer, int kind, int panel) const {
+        int nbBlocksPerRow = producer.params.nbBlocksPerRow;
+        switch (kind) {
+        case LEFT_INPUT:
+            return producer.nbRowJobsDone[panel] == nbBlocksPerRow;
+        case RIGHT_INPUT:
+            return producer.nbColumnJobsDone[panel] == nbBlocksPerRow;
+        default:
+            return producer.nbJobsFinished == producer.nbJobs;
+        }
+    }
+
+    ///
+    /// \brief Queues a block of a dependent computation whose inputs are all ready
+    ///
+    void releaseJob(int id, int index) {
+        ComputationSlot& slot = slots[id];
+        if (slot.nextJob == slot.nbReleased) {
+            pushReady(id);
+        }
+        slot.releasedJobs[slot.nbReleased++] = index;
+        nbQueuedJobs++;
+        nbQueuedWork += slot.jobWork;
+        nbReleasedJobs++;
+    }
+
+    ///
+    /// \brief Counts an input of the blocks of a dependent computation that a panel feeds, releasing the ready ones
+    /// \param id The dependent computation
+    /// \param kind How the dependent reads the panel
+    /// \param panel Index of the row or column panel, ignored for the whole inputs
+    ///
+    void panelReady(int id, int kind, int panel) {
+        ComputationSlot& slot = slots[id];
+        int nbBlocksPerRow = slot.params.nbBlocksPerRow;
+        int first = 0;
+        int last = slot.nbJobs;
+        int stride = 1;
+        if (kind == LEFT_INPUT) {
+            first = panel * nbBlocksPerRow;
+            last = first + nbBlocksPerRow;
+        }
+        else if (kind == RIGHT_INPUT) {
+            first = panel;
+            stride = nbBlocksPerRow;
+        }
+        for (int index = first; index < last; index += stride) {
+            if (--slot.nbMissingInputs[index] == 0) {
+                releaseJob(id, index);
+            }
+        }
+    }
+
+    ///
+    /// \brief Forwards a finished panel of a producer to the dependents reading it
+    ///
+    void forwardPanel(int producerId, int kind, int panel) {
+        for (int edge = slots[producerId].firstDependent; edge != NO_SLOT; ) {
+            int id = edge / NB_INPUT_KINDS;
+            int edgeKind = edge % NB_INPUT_KINDS;
+            edge = slots[id].nextDependent[edgeKind];
+            if (edgeKind == kind || (isWholeInput(kind) && isWholeInput(edgeKind))) {
+                panelReady(id, kind, panel);
+            }
+        }
+    }
+
+    ///
+    /// \brief Makes the blocks released since the last call visible to the workers
+    ///
+    void publishReleasedJobs() {
+        if (nbReleasedJobs == 0) {
+            return;
+        }
+        int nbReleased = nbReleasedJobs;
+        nbReleasedJobs = 0;
+        nbQueuedJobsHint.store(nbQueuedJobs, std::memory_order_release);
+        if (jobsReleasedHandler) {
+            jobsReleasedHandler(jobsReleasedContext, nbReleased);
+        }
+        wakeWorkers();
+    }
+
+    ///
+    /// \brief Removes a dependent computation from the list of one of its producers
+    ///
+    void unlinkProducer(int id, int kind) {
+        int producerId = slots[id].producers[kind];
+        if (producerId == NO_SLOT) {
+            return;
+        }
+        int edge = id * NB_INPUT_KINDS + kind;
+        int* link = &slots[producerId].firstDependent;
+        while (*link != edge) {
+            link = &slots[*link / NB_INPUT_KINDS].nextDependent[*link % NB_INPUT_KINDS];
+        }
+        *link = slots[id].nextDependent[kind];
+        slots[id].producers[kind] = NO_SLOT;
+    }
+
+    ///
+    /// \brief Wakes the caller waiting for a computation whose jobs are all finished, or queues its callback
+    ///
+    void computationFinished(int id) {
+        ComputationSlot& slot = slots[id];
+        // The dependents reading the whole result can start, the others got all their panels already
+        if (!slot.isAborted) {
+            forwardPanel(id, WHOLE_INPUT, 0);
+        }
+        // The slot may be reused, the dependents must no longer refer to it
+        while (slot.firstDependent != NO_SLOT) {
+            int edge = slot.firstDependent;
+            slot.firstDependent = slots[edge / NB_INPUT_KINDS].nextDependent[edge % NB_INPUT_KINDS];
+            slots[edge / NB_INPUT_KINDS].producers[edge % NB_INPUT_KINDS] = NO_SLOT;
+        }
+        if (slot.onDone.function) {
+            // Run by leaveMonitor(), user code must not run inside the monitor
+            slot.nextFinished = firstFinished;
+            firstFinished = id;
+        }
+        else {
+            signal(slot.allJobsDone);
+        }
+    }
+
+    ///
+    /// \brief Leaves the monitor, then runs the callbacks of the computations that just finished
+    ///
+    void leaveMonitor() {
+        bool hasCallbacks = firstFinished != NO_SLOT;
+        monitorOut();
+        while (hasCallbacks) {
+            monitorIn();
+            int id = firstFinished;
+            hasCallbacks = id != NO_SLOT;
+            CompletionCallback onDone;
+            bool completed = false;
+            if (hasCallbacks) {
+                firstFinished = slots[id].nextFinished;
+                onDone = slots[id].onDone;
+                completed = !slots[id].isAborted;
+                freeSlot(id);
+            }
+            monitorOut();
+            if (hasCallbacks) {
+                // Counted as a job, so that a product started by the callback neither waits for room in the
+                // queue nor resizes the pool this thread may belong to, and computes its blocks if it waits
+                jobNestingDepth()++;
+                onDone.function(onDone.context, completed);
+                jobNestingDepth()--;
+            }
+        }
+    }
+
+    ///
+    /// \brief Drops the blocks of a computation that were not handed out yet, and those of its dependents
+    /// \return The number of blocks dropped
+    ///
+    /// The dropped blocks count as finished so that no caller waits for them. The dependents can never get
+    /// their inputs, their blocks are dropped as well.
+    ///
+    int abortPendingJobs(int id) {
+        ComputationSlot& slot = slots[id];
+        int nbAborted = slot.nbJobs - slot.nextJob;
+        for (int kind = 0; kind < NB_INPUT_KINDS; ++kind) {
+            unlinkProducer(id, kind);
+        }
+        if (nbAborted == 0) {
+            return 0;
+        }
+        int nbQueued = slot.nbReleased - slot.nextJob;
+        if (nbQueued > 0) {
+            removeReady(id);
+            nbQueuedJobs -= nbQueued;
+            nbQueuedWork -= slot.jobWork * nbQueued;
+            nbQueuedJobsHint.store(nbQueuedJobs, std::memory_order_release);
+        }
+        slot.nextJob = slot.nbReleased = slot.nbJobs;
+        slot.nbJobsFinished += nbAborted;
+        slot.isAborted = true;
+        while (slot.firstDependent != NO_SLOT) {
+            abortPendingJobs(slot.firstDependent / NB_INPUT_KINDS);
+        }
+        if (slot.nbJobsFinished == slot.nbJobs) {
+            computationFinished(id);
+        }
+        return nbAborted;
+    }
+    
+    ///
+    /// \brief Tells if a worker that no longer belongs to the pool still waits for a job
+    ///
+    bool hasIdleRetiredWorker() const {
+        for (size_t id = nbWorkersWanted; id < idleWorkers.size(); ++id) {
+            if (idleWorkers[id]) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    ///
+    /// \brief Lets a submitter waiting for room check again, after jobs left the queue
+    ///
+    void notifySpaceAvailable() {
+        if (nbWaitingSubmitters > 0) {
+            signal(spaceAvailable);
+        }
+    }
+    
+    ///
+    /// \brief Busy waits outside of the monitor for a job to be queued, following the idle strategy
+    ///
+    void spinUntilJob() {
+        int spins = nbSpins.load(std::memory_order_relaxed);
+        int yields = nbYields.load(std::memory_order_relaxed);
+        if (spins + yields == 0) {
+            return;
+        }
+        nbSpinningWorkers.fetch_add(1, std::memory_order_acq_rel);
+        for (int i = 0; i < spins && nbQueuedJobsHint.load(std::memory_order_acquire) == 0; ++i) {
+            cpuRelax();
+        }
+        for (int i = 0; i < yields && nbQueuedJobsHint.load(std::memory_order_acquire) == 0; ++i) {
+            std::this_thread::yield();
+        }
+        nbSpinningWorkers.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    std::deque<ComputationSlot> slots;  // A deque never moves its elements, the conditions stay in place
+    std::vector<int> freeSlots;
+    int firstReady{NO_SLOT};           // FIFO of the computations with queued jobs
+    int lastReady{NO_SLOT};
+    int nbQueuedJobs{0};               // Jobs not yet handed out, over all computations
+    int nbReleasedJobs{0};             // Jobs of dependent computations queued since the last publication
+    int firstFinished{NO_SLOT};        // Computations over whose callback has not run yet
+    void (*jobsReleasedHandler)(void*, int){nullptr};
+    void* jobsReleasedContext{nullptr};
+    long long coalescingBudget{DEFAULT_COALESCING_BUDGET};
+    long long nbQueuedWork{0};         // Multiply-adds of the queued jobs
+    int maxQueuedJobs{0};              // Capacity of the queue, 0 when unbounded
+    long long maxQueuedWork{0};
+    int nbWaitingSubmitters{0};        // Callers blocked on spaceAvailable
+    long long nbAdmitted{0};
+    long long nbRejected{0};
+    PcoHoareMonitor::Condition spaceAvailable;
+    PcoHoareMonitor::Condition jobAvailable;
+    bool isTerminating;
+    int nbWorkersWanted;  // Workers with a smaller index may take jobs
+    int nbIdleWorkers;    // Workers blocked on jobAvailable
+    std::vector<bool> idleWorkers; // Per worker index, true while blocked on jobAvailable
+    int nbRunningJobs;    // Jobs between getJobs() and jobsCompleted(), a worker may run several coalesced ones
+    std::chrono::steady_clock::time_point lastSaturated; // Last time no worker was idle
+    
+    // Read outside of the monitor by the spinning workers
+    std::atomic<int> nbQueuedJobsHint{0};
+    std::atomic<int> nbSpinningWorkers{0};
+    std::atomic<int> nbSpins{0};
+    std::atomic<int> nbYields{0};
+};
+
+
+///
+/// Parameters of the automatic resizing of a ThreadedMatrixMultiplier pool.
+///
+/// Before and after each multiply() the pool is grown immediately up to the demand (queued jobs plus
+/// running jobs plus the incoming jobs), and shrunk down to it once the pool has not been fully
+/// used for idleTimeout. The number of threads always stays within [minThreads, maxThreads].
+///
+struct AutoScalePolicy
+{
+    int minThreads{1};
+    int maxThreads{1};
+    std::chrono::milliseconds idleTimeout{100};
+};
+
+
+
+///
+/// A multi-threaded multiplicator. multiply() should at least be reentrant.
+/// It is up to you to offer a very good parallelism.
+///
+template<class T>
+class ThreadedMatrixMultiplier : public AbstractMatrixMultiplier<T>, protected SharedWorkerPool::Client
+{
+
+public:
+    ///
+    /// \brief ThreadedMatrixMultiplier
+    /// \param nbThreads Number of threads to start
+    /// \param nbBlocksPerRow Default number of blocks per row, for compatibility with SimpleMatrixMultiplier
+    ///
+    /// The threads shall be started from the constructor
+    ///
+    ThreadedMatrixMultiplier(int nbThreads, int nbBlocksPerRow = 0)
+        : nbThreads(0), nbBlocksPerRow(nbBlocksPerRow)
+    {
+        buffer = std::make_unique<Buffer<T>>();
+        
+        // Create and start worker threads
+        resizePool(nbThreads);
+    }
+
+    ///
+    /// \brief ThreadedMatrixMultiplier running its jobs on a pool shared with other multipliers
+    /// \param pool The pool to submit the jobs to, for instance SharedWorkerPool::instance()
+    /// \param nbBlocksPerRow Default number of blocks per row, for compatibility with SimpleMatrixMultiplier
+    ///
+    /// No thread is started by the multiplier itself, and the pool size cannot be changed through it.
+    ///
+    ThreadedMatrixMultiplier(SharedWorkerPool& pool, int nbBlocksPerRow = 0)
+        : nbThreads(0), nbBlocksPerRow(nbBlocksPerRow), sharedPool(&pool)
+    {
+        buffer = std::make_unique<Buffer<T>>();
+        sharedPool->registerClient(this);
+        buffer->setJobsReleasedHandler(&ThreadedMatrixMultiplier::submitReleasedJobs, this);
+    }
+
+    ///
+    /// In this destructor we should ask for the termination of the computations. They could be aborted without
+    /// ending into completion.
+    /// All threads have to be joined.
+    ///
+    ~ThreadedMatrixMultiplier()
+    {
+        // Withdraw from the shared pool, once none of its workers runs one of our jobs anymore
+        if (sharedPool) {
+            buffer->setJobsReleasedHandler(nullptr, nullptr);
+            sharedPool->unregisterClient(this);
+        }
+        
+        // Signal termination to all threads
+        buffer->terminate();
+        
+        // Wait for all threads to finish
+        for (auto& thread : threads) {
+            thread->join();
+        }
+    }
+
+    ///
+    /// \brief Changes the number of worker threads
+    /// \param nbThreads New number of threads
+    ///
+    /// New threads start right away. Retired threads finish the job they are computing and leave before taking
+    /// another one, so the computations in progress are not affected. Returns once the retired threads are joined.
+    /// Has no effect on a multiplier running on a SharedWorkerPool.
+    ///
+    void setThreadCount(int nbThreads)
+    {
+        poolMutex.lock();
+        resizePool(std::max(nbThreads, 1));
+        poolMutex.unlock();
+    }
+
+    ///
+    /// \brief Returns the current number of worker threads, the size of the pool for a shared one
+    ///
+    int getThreadCount()
+    {
+        if (sharedPool) {
+            return sharedPool->getThreadCount();
+        }
+        poolMutex.lock();
+        int count = nbThreads;
+        poolMutex.unlock();
+        return count;
+    }
+
+    ///
+    /// \brief Sets how much work may be handed out at once to a worker, see Buffer::setCoalescingBudget
+    ///
+    /// Only applies to the threads of this multiplier, the workers of a SharedWorkerPool run one block at a time.
+    ///
+    void setCoalescingBudget(long long nbMultiplyAdds)
+    {
+        buffer->setCoalescingBudget(nbMultiplyAdds);
+    }
+
+    ///
+    /// \brief Changes the way idle workers wait for jobs, see IdleStrategy
+    ///
+    /// Only applies to the threads of this multiplier, the workers of a SharedWorkerPool always park.
+    ///
+    void setIdleStrategy(const IdleStrategy& strategy)
+    {
+        buffer->setIdleStrategy(strategy);
+    }
+
+    ///
+    /// \brief Makes the products bitwise reproducible, see computeTileDeterministic()
+    /// \param enabled true to sum each element with a fixed reduction tree, false for the default kernel
+    ///
+    /// Applies to the products started afterwards.
+    ///
+    void setDeterministic(bool enabled)
+    {
+        deterministic.store(enabled, std::memory_order_relaxed);
+    }
+
+    ///
+    /// \brief Returns the jobs accounted to this multiplier by its shared pool, zeros without a shared pool
+    ///
+    SharedWorkerPool::ClientStats getSharedPoolStats()
+    {
+        if (sharedPool) {
+            return sharedPool->getStats(this);
+        }
+        return {};
+    }
+
+    ///
+    /// \brief Enables the automatic resizing of the pool
+    /// \param policy Bounds and idle timeout to apply
+    ///
+    void enableAutoScaling(const AutoScalePolicy& policy)
+    {
+        poolMutex.lock();
+        autoScalePolicy = policy;
+        autoScalePolicy.minThreads = std::max(policy.minThreads, 1);
+        autoScalePolicy.maxThreads = std::max(policy.maxThreads, autoScalePolicy.minThreads);
+        autoScaling = true;
+        resizePool(std::clamp(nbThreads, autoScalePolicy.minThreads, autoScalePolicy.maxThreads));
+        poolMutex.unlock();
+    }
+
+    ///
+    /// \brief Disables the automatic resizing, the pool keeps its current size
+    ///
+    void disableAutoScaling()
+    {
+        poolMutex.lock();
+        autoScaling = false;
+        poolMutex.unlock();
+    }
+
+    ///
+    /// \brief multiply
+    /// \param A First matrix
+    /// \param B Second matrix
+    /// \param C Result of AxB
+    ///
+    /// For compatibility reason with SimpleMatrixMultiplier
+    void multiply(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C) override
+    {
+        multiply(A, B, C, nbBlocksPerRow);
+    }
+
+    ///
+    /// \brief multiply
+    /// \param A First matrix
+    /// \param B Second matrix
+    /// \param C Result of AxB
+    /// \param nbBlocksPerRow Number of blocks per row (or columns)
+    ///
+    /// Executes the multithreaded computation, by decomposing the matrices into blocks.
+    /// nbBlocksPerRow must divide the size of the matrix.
+    ///
+    void multiply(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C, int nbBlocksPerRow)
+    {
+        int totalBlocks = nbBlocksPerRow * nbBlocksPerRow;
+        
+        // Make sure the pool is big enough for the burst to come
+        autoScale(totalBlocks);
+        
+        // Start a new computation, which makes all its jobs available to the workers.
+        // There is no need to clear C, each block overwrites its part of it.
+        int computationId = buffer->startNewComputation(makeParameters(A, B, C, nbBlocksPerRow), totalBlocks);
+        
+        completeComputation(computationId, totalBlocks);
+    }
+
+    ///
+    /// \brief Computes C += A * B
+    /// \param A First matrix
+    /// \param B Second matrix
+    /// \param C Matrix the product is added to, it must not be A or B
+    /// \param nbBlocksPerRow Number of blocks per row (or columns)
+    ///
+    /// Each block starts its sums from the elements of C, so accumulating several products into C takes
+    /// neither a temporary matrix nor an extra pass over C.
+    ///
+    void multiplyAccumulate(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C,
+                            int nbBlocksPerRow)
+    {
+        int totalBlocks = nbBlocksPerRow * nbBlocksPerRow;
+        autoScale(totalBlocks);
+        
+        ComputeParameters<T> params = makeParameters(A, B, C, nbBlocksPerRow);
+        params.accumulate = true;
+        int computationId = buffer->startNewComputation(params, totalBlocks);
+        completeComputation(computationId, totalBlocks);
+    }
+
+    ///
+    /// \brief Updates C = A * B after some rows of A and/or some columns of B were modified
+    /// \param A First matrix, its modified rows are marked, see Matrix::updateElement()
+    /// \param B Second matrix, its modified columns are marked
+    /// \param C Result of AxB, holding the product of the previous values of A and B
+    /// \param nbBlocksPerRow Number of blocks per row (or columns)
+    /// \return Number of blocks recomputed
+    ///
+    /// A row of A only takes part in the same row of C, and a column of B in the same column of C. Only the
+    /// blocks of the row panels of C with a modified row of A, and of the column panels with a modified column
+    /// of B, are recomputed. The marks of A and B are cleared once the product is over.
+    ///
+    /// Every modified element lies in a marked row and in a marked column (see Matrix::markRowsDirty()), so a
+    /// modified row of B or column of A has all the columns of B or rows of A marked, and A and B may be the
+    /// same matrix.
+    ///
+    int multiplyIncremental(SquareMatrix<T>& A, SquareMatrix<T>& B, SquareMatrix<T>& C, int nbBlocksPerRow)
+    {
+        int blockSize = A.size() / nbBlocksPerRow;
+        std::vector<bool> isRowPanelDirty(nbBlocksPerRow);
+        std::vector<bool> isColumnPanelDirty(nbBlocksPerRow);
+        for (int k = 0; k < A.size(); ++k) {
+            if (A.isRowDirty(k)) {
+                isRowPanelDirty[k / blockSize] = true;
+            }
+            if (B.isColumnDirty(k)) {
+                isColumnPanelDirty[k / blockSize] = true;
+            }
+        }
+        std::vector<int> tiles;
+        for (int blockI = 0; blockI < nbBlocksPerRow; ++blockI) {
+            for (int blockJ = 0; blockJ < nbBlocksPerRow; ++blockJ) {
+                if (isRowPanelDirty[blockI] || isColumnPanelDirty[blockJ]) {
+                    tiles.push_back(blockI * nbBlocksPerRow + blockJ);
+                }
+            }
+        }
+        
+        multiplyTiles(A, B, C, nbBlocksPerRow, tiles);
+        A.clearDirty();
+        B.clearDirty();
+        return static_cast<int>(tiles.size());
+    }
+
+    ///
+    /// \brief Computes the rank-k update C += U * V^T
+    /// \param U Matrix of n rows and k columns
+    /// \param V Matrix of n rows and k columns
+    /// \param C Matrix of size n the update is added to
+    /// \param nbBlocksPerRow Number of blocks per row (or columns) of C
+    ///
+    /// Costs n * n * k multiply-adds instead of n * n * n for a product. For instance, when A changes by
+    /// A += U * V^T, C = A * B changes by U * (B^T * V)^T.
+    ///
+    void rankUpdate(const Matrix<T>& U, const Matrix<T>& V, SquareMatrix<T>& C, int nbBlocksPerRow)
+    {
+        RankUpdate update{&U, &V, &C, C.size() / nbBlocksPerRow};
+        long long tileWork = static_cast<long long>(update.blockSize) * update.blockSize * std::max(U.getSizeX(), 1);
+        runTiles(nbBlocksPerRow, &ThreadedMatrixMultiplier::computeRankUpdateTile, &update, tileWork);
+    }
+
+    ///
+    /// \brief Computes C = A * B before a deadline
+    /// \param A First matrix
+    /// \param B Second matrix
+    /// \param C Result of AxB
+    /// \param nbBlocksPerRow Number of blocks per row (or columns)
+    /// \param deadline Time by which the product is needed
+    /// \return Completed, or TimedOut if the deadline passed: the remaining blocks are then cancelled
+    ///
+    /// The blocks of the computations with the earliest deadline are handed out first. On timeout, the call
+    /// returns once the blocks being computed are over, which may be slightly after the deadline.
+    ///
+    MultiplyStatus multiply(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C, int nbBlocksPerRow,
+                            std::chrono::steady_clock::time_point deadline)
+    {
+        int computationId = startMultiply(A, B, C, nbBlocksPerRow, deadline);
+        if (waitUntil(computationId, deadline)) {
+            return MultiplyStatus::Completed;
+        }
+        cancel(computationId);
+        return MultiplyStatus::TimedOut;
+    }
+
+    ///
+    /// \brief Queues the computation of C = A * B and returns without waiting for it
+    /// \param A First matrix
+    /// \param B Second matrix
+    /// \param C Result of AxB
+    /// \param nbBlocksPerRow Number of blocks per row (or columns)
+    /// \param deadline Time by which the product is needed, used to order the computations
+    /// \return The ID of the computation, to pass to waitUntil() or cancel()
+    ///
+    /// The matrices must outlive the computation, which ends when waitUntil() returns true or cancel() returns.
+    ///
+    int startMultiply(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C, int nbBlocksPerRow,
+                      std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max())
+    {
+        int totalBlocks = nbBlocksPerRow * nbBlocksPerRow;
+        autoScale(totalBlocks);
+        
+        ComputeParameters<T> params = makeParameters(A, B, C, nbBlocksPerRow);
+        params.deadline = deadline;
+        int computationId = buffer->startNewComputation(params, totalBlocks);
+        if (sharedPool) {
+            sharedPool->submit(this, totalBlocks);
+        }
+        return computationId;
+    }
+
+    ///
+    /// \brief Queues the computation of C = A * B and calls a function once it is over, nobody waits for it
+    /// \param A First matrix
+    /// \param B Second matrix
+    /// \param C Result of AxB
+    /// \param nbBlocksPerRow Number of blocks per row (or columns)
+    /// \param onDone Called by the thread finishing the last block, or by the destructor if blocks are dropped
+    ///
+    /// No thread is blocked while the product runs, which makes it the base of MultiplyAwaitable. The
+    /// callback should return quickly, or hand its work over to another thread, since it runs on a worker.
+    /// It may start other products: it runs as a job, so a product it waits for is computed by this thread.
+    ///
+    void startMultiply(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C, int nbBlocksPerRow,
+                       const CompletionCallback& onDone)
+    {
+        int totalBlocks = nbBlocksPerRow * nbBlocksPerRow;
+        autoScale(totalBlocks);
+        
+        buffer->startNewComputation(makeParameters(A, B, C, nbBlocksPerRow), totalBlocks, onDone);
+        if (sharedPool) {
+            sharedPool->submit(this, totalBlocks);
+        }
+    }
+
+    ///
+    /// \brief Computes C = A * B, handing each block over to a consumer as soon as it is computed
+    /// \param A First matrix
+    /// \param B Second matrix
+    /// \param C Result of AxB
+    /// \param nbBlocksPerRow Number of blocks per row (or columns)
+    /// \param onTile Called by the worker that computed a block, in the order the blocks complete
+    ///
+    /// Returns once all the blocks are computed and all the calls to onTile returned. See tilestream.h for
+    /// an ordered release of the row panels and for a queue of the computed blocks.
+    ///
+    void multiply(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C, int nbBlocksPerRow,
+                  const TileCallback& onTile)
+    {
+        int totalBlocks = nbBlocksPerRow * nbBlocksPerRow;
+        autoScale(totalBlocks);
+        
+        ComputeParameters<T> params = makeParameters(A, B, C, nbBlocksPerRow);
+        params.onTileDone = onTile;
+        int computationId = buffer->startNewComputation(params, totalBlocks);
+        completeComputation(computationId, totalBlocks);
+    }
+
+    ///
+    /// \brief Computes only some blocks of C = A * B, the others being left untouched
+    /// \param A First matrix
+    /// \param B Second matrix
+    /// \param C Result of AxB
+    /// \param nbBlocksPerRow Number of blocks per row (or columns)
+    /// \param tiles Row-major indices of the blocks to compute, blockI * nbBlocksPerRow + blockJ
+    /// \param onTile Called by the worker that computed a block, in the order the blocks complete
+    ///
+    void multiplyTiles(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C, int nbBlocksPerRow,
+                       const std::vector<int>& tiles, const TileCallback& onTile = {})
+    {
+        int totalBlocks = static_cast<int>(tiles.size());
+        if (totalBlocks == 0) {
+            return;
+        }
+        autoScale(totalBlocks);
+        
+        ComputeParameters<T> params = makeParameters(A, B, C, nbBlocksPerRow);
+        params.selectedTiles = tiles.data();
+        params.onTileDone = onTile;
+        int computationId = buffer->startNewComputation(params, totalBlocks);
+        completeComputation(computationId, totalBlocks);
+    }
+
+    ///
+    /// \brief Queues the computation of C = A * B, with a callback per block and one at the end
+    /// \param A First matrix
+    /// \param B Second matrix
+    /// \param C Result of AxB
+    /// \param nbBlocksPerRow Number of blocks per row (or columns)
+    /// \param onDone Called once the product is over, after the last call to onTile returned
+    /// \param onTile Called by the worker that computed a block, in the order the blocks complete
+    ///
+    void startMultiply(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C, int nbBlocksPerRow,
+                       const CompletionCallback& onDone, const TileCallback& onTile)
+    {
+        int totalBlocks = nbBlocksPerRow * nbBlocksPerRow;
+        autoScale(totalBlocks);
+        
+        ComputeParameters<T> params = makeParameters(A, B, C, nbBlocksPerRow);
+        params.onTileDone = onTile;
+        buffer->startNewComputation(params, totalBlocks, onDone);
+        if (sharedPool) {
+            sharedPool->submit(this, totalBlocks);
+        }
+    }
+
+    ///
+    /// \brief Waits for a computation started by startMultiply(), at most until a deadline
+    /// \param computationId The ID of the computation
+    /// \param deadline Time at which to give up waiting
+    /// \return true if the computation is over, its ID is then no longer valid. false on timeout.
+    ///
+    /// The Hoare monitor offers no timed wait, so the completion is polled with a growing sleep in between.
+    ///
+    bool waitUntil(int computationId, std::chrono::steady_clock::time_point deadline)
+    {
+        if (jobNestingDepth() > 0) {
+            helpWithJobsOf(computationId, deadline);
+        }
+        uint64_t sleepUs = 20;
+        while (!buffer->releaseIfDone(computationId)) {
+            auto now = std::chrono::steady_clock::now();
+            if (now >= deadline) {
+                return false;
+            }
+            auto left = std::chrono::duration_cast<std::chrono::microseconds>(deadline - now).count();
+            PcoThread::usleep(std::min<uint64_t>(sleepUs, static_cast<uint64_t>(left)));
+            sleepUs = std::min<uint64_t>(sleepUs * 2, 1000);
+        }
+        autoScale(0);
+        return true;
+    }
+
+    ///
+    /// \brief Cancels the blocks of a computation started by startMultiply() that are not computed yet
+    /// \param computationId The ID of the computation, no longer valid afterwards
+    /// \return true if blocks were cancelled, in which case C is incomplete
+    ///
+    /// Returns once the blocks being computed are over.
+    ///
+    bool cancel(int computationId)
+    {
+        bool cancelled = buffer->cancelComputation(computationId);
+        autoScale(0);
+        return cancelled;
+    }
+
+    ///
+    /// \brief Queues the computation of C = A * B, where A and/or B are being computed by other computations
+    /// \param A First matrix, possibly the result of producerId or otherProducerId
+    /// \param B Second matrix, possibly the result of producerId or otherProducerId
+    /// \param C Result of AxB
+    /// \param nbBlocksPerRow Number of blocks per row (or columns)
+    /// \param producerId ID returned by startMultiply() or startMultiplyAfter() for a product not waited for yet
+    /// \param otherProducerId ID of a second producer, or NO_COMPUTATION
+    /// \return The ID of the computation, to pass to wait(), waitUntil() or cancel()
+    ///
+    /// A block of C only needs a row panel of A and a column panel of B, so each block is queued as soon as the
+    /// panels it reads are computed rather than when the producers are over. With the same nbBlocksPerRow, the
+    /// stages of a chain of products overlap. Cancelling a producer cancels its dependents.
+    ///
+    int startMultiplyAfter(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C, int nbBlocksPerRow,
+                           int producerId, int otherProducerId = NO_COMPUTATION)
+    {
+        int totalBlocks = nbBlocksPerRow * nbBlocksPerRow;
+        autoScale(totalBlocks);
+        
+        // The shared pool is told about the blocks as they are released, see submitReleasedJobs()
+        return buffer->startDependentComputation(makeParameters(A, B, C, nbBlocksPerRow), totalBlocks,
+                                                 producerId, otherProducerId);
+    }
+
+    ///
+    /// \brief Waits for a computation started by startMultiply() or startMultiplyAfter()
+    /// \param computationId The ID of the computation, no longer valid afterwards
+    ///
+    void wait(int computationId)
+    {
+        if (jobNestingDepth() > 0) {
+            helpWithJobsOf(computationId, std::chrono::steady_clock::time_point::max());
         }
-        
-        // Wait for all jobs of this computation to complete
         buffer->waitAllJobsDone(computationId);
+        autoScale(0);
+    }
+
+    ///
+    /// \brief Computes AB = A * B and D = AB * E, overlapping the two products
+    /// \param A First matrix
+    /// \param B Second matrix
+    /// \param E Third matrix
+    /// \param AB Result of AxB
+    /// \param D Result of AxBxE
+    /// \param nbBlocksPerRow Number of blocks per row (or columns), used by both products
+    ///
+    /// The row panel i of D is started as soon as the row panel i of AB is computed.
+    ///
+    void multiplyChain(const SquareMatrix<T>& A, const SquareMatrix<T>& B, const SquareMatrix<T>& E,
+                       SquareMatrix<T>& AB, SquareMatrix<T>& D, int nbBlocksPerRow)
+    {
+        int producerId = startMultiply(A, B, AB, nbBlocksPerRow);
+        int computationId = startMultiplyAfter(AB, E, D, nbBlocksPerRow, producerId);
+        wait(producerId);
+        wait(computationId);
+    }
+
+    ///
+    /// \brief Chooses the number of blocks per row of a grid for runTiles()
+    /// \param nbElements Number of elements the grid is split into
+    /// \param minBlockElements Smallest number of elements per block worth a block of its own
+    /// \return The number of blocks per row, at least 1
+    ///
+    /// Aims at two blocks per thread, but stops splitting when blocks would get smaller than minBlockElements.
+    ///
+    int chooseBlocksPerRow(long long nbElements, long long minBlockElements = 32 * 32)
+    {
+        int nbBlocks = 2 * getThreadCount();
+        int nbBlocksPerRow = 1;
+        while (nbBlocksPerRow * nbBlocksPerRow < nbBlocks) {
+            long long nextBlocks = static_cast<long long>(nbBlocksPerRow + 1) * (nbBlocksPerRow + 1);
+            if (nbElements / nextBlocks < minBlockElements) {
+                break;
+            }
+            nbBlocksPerRow++;
+        }
+        return nbBlocksPerRow;
+    }
+
+    ///
+    /// \brief Runs a grid of blocks computed by a caller-supplied kernel on the pool, and waits for them
+    /// \param nbBlocksPerRow Number of blocks per row (or columns) of the grid
+    /// \param tileKernel Computes the block (blockI, blockJ), it must only write data of its own block
+    /// \param context Passed to the kernel
+    /// \param tileWork Approximate number of multiply-adds of a block, used to coalesce small blocks
+    ///
+    /// Lets other products than the square one of SquareMatrix, for instance a BLAS gemm, use the pool
+    /// with the same scheduling as multiply().
+    ///
+    void runTiles(int nbBlocksPerRow, void (*tileKernel)(void*, int, int), void* context, long long tileWork)
+    {
+        int totalBlocks = nbBlocksPerRow * nbBlocksPerRow;
+        autoScale(totalBlocks);
+        
+        ComputeParameters<T> params;
+        params.nbBlocksPerRow = nbBlocksPerRow;
+        params.tileKernel = tileKernel;
+        params.kernelContext = context;
+        params.tileWork = tileWork;
+        int computationId = buffer->startNewComputation(params, totalBlocks);
+        completeComputation(computationId, totalBlocks);
+    }
+
+    ///
+    /// \brief Computes C = A * B only if the queue has room for it right now
+    /// \param A First matrix
+    /// \param B Second matrix
+    /// \param C Result of AxB
+    /// \param nbBlocksPerRow Number of blocks per row (or columns)
+    /// \return true once the product is computed, false if it was rejected without touching C
+    ///
+    bool tryMultiply(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C, int nbBlocksPerRow)
+    {
+        return multiplyUntil(A, B, C, nbBlocksPerRow, std::chrono::steady_clock::now());
+    }
+
+    ///
+    /// \brief Computes C = A * B if the queue has room for it within a given time
+    /// \param A First matrix
+    /// \param B Second matrix
+    /// \param C Result of AxB
+    /// \param nbBlocksPerRow Number of blocks per row (or columns)
+    /// \param timeout Maximal time spent waiting for room in the queue
+    /// \return true once the product is computed, false if it was rejected without touching C
+    ///
+    /// The timeout only bounds the admission: once queued, the computation runs to completion.
+    ///
+    template<class Rep, class Period>
+    bool multiplyFor(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C, int nbBlocksPerRow,
+                     std::chrono::duration<Rep, Period> timeout)
+    {
+        return multiplyUntil(A, B, C, nbBlocksPerRow, std::chrono::steady_clock::now() + timeout);
+    }
+
+    ///
+    /// \brief Bounds the job queue, see Buffer::setQueueCapacity
+    /// \param maxJobs Maximal number of queued blocks, 0 for no limit
+    /// \param maxWork Maximal number of multiply-adds of the queued blocks, 0 for no limit
+    ///
+    /// multiply() then waits for room in the queue, tryMultiply() and multiplyFor() give up.
+    ///
+    void setQueueCapacity(int maxJobs, long long maxWork = 0)
+    {
+        buffer->setQueueCapacity(maxJobs, maxWork);
+    }
+
+    ///
+    /// \brief Returns the current depth of the job queue and the admission counters
+    ///
+    QueueMetrics getQueueMetrics()
+    {
+        return buffer->getQueueMetrics();
     }
 
+    //! Producer ID meaning that the operand is already computed
+    static constexpr int NO_COMPUTATION = -1;
+
 protected:
     int nbThreads;
     int nbBlocksPerRow;
@@ -295,65 +1858,260 @@ protected:
     std::unique_ptr<Buffer<T>> buffer;
     std::vector<std::unique_ptr<PcoThread>> threads;
     
+    PcoMutex poolMutex; // Protects threads, nbThreads and the auto scaling settings
+    bool autoScaling{false};
+    AutoScalePolicy autoScalePolicy;
+    
+    SharedWorkerPool* sharedPool{nullptr}; // Pool running the jobs instead of our own threads, if any
+    
+    std::atomic<bool> deterministic{false}; // See setDeterministic()
+    
+    //! Maximal number of blocks a worker takes at once
+    static constexpr int MAX_COALESCED_JOBS = 32;
+    
+    //! Operands of rankUpdate(), shared by all its blocks
+    struct RankUpdate
+    {
+        const Matrix<T>* U;
+        const Matrix<T>* V;
+        SquareMatrix<T>* C;
+        int blockSize;
+    };
+    
+    ///
+    /// \brief Adds the block (blockI, blockJ) of U * V^T to C
+    /// \param context The RankUpdate
+    ///
+    static void computeRankUpdateTile(void* context, int blockI, int blockJ)
+    {
+        const RankUpdate& update = *static_cast<const RankUpdate*>(context);
+        int k = update.U->getSizeX();
+        for (int i = blockI * update.blockSize; i < (blockI + 1) * update.blockSize; ++i) {
+            for (int j = blockJ * update.blockSize; j < (blockJ + 1) * update.blockSize; ++j) {
+                T sum = update.C->element(j, i);
+                for (int l = 0; l < k; ++l) {
+                    sum += update.U->element(l, i) * update.V->element(l, j);
+                }
+                update.C->setElement(j, i, sum);
+            }
+        }
+    }
+    
+    ///
+    /// \brief Runs one of our queued jobs, called by the workers of the shared pool
+    /// \return false if no job was queued
+    ///
+    bool runPendingJob() override
+    {
+        TileJob<T> job;
+        if (!buffer->tryGetJob(job)) {
+            return false;
+        }
+        computeBlock(job);
+        buffer->jobCompleted(job);
+        return true;
+    }
+    
+    ///
+    /// \brief Tells the shared pool about blocks of dependent computations whose inputs became ready
+    /// \param context The multiplier
+    /// \param nbJobs Number of blocks released
+    ///
+    static void submitReleasedJobs(void* context, int nbJobs)
+    {
+        auto* multiplier = static_cast<ThreadedMatrixMultiplier*>(context);
+        multiplier->sharedPool->submit(multiplier, nbJobs);
+    }
+    
+    ///
+    /// \brief Gathers the parameters shared by all the jobs of a computation
+    ///
+    ComputeParameters<T> makeParameters(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C,
+                                        int nbBlocksPerRow) const
+    {
+        ComputeParameters<T> params;
+        params.A = &A;
+        params.B = &B;
+        params.C = &C;
+        params.nbBlocksPerRow = nbBlocksPerRow;
+        params.deterministic = deterministic.load(std::memory_order_relaxed);
+        return params;
+    }
+    
+    ///
+    /// \brief Waits for a started computation to complete
+    /// \param computationId The ID of the computation
+    /// \param totalBlocks Number of jobs of the computation
+    ///
+    void completeComputation(int computationId, int totalBlocks)
+    {
+        // Let the workers of the shared pool know about the new jobs
+        if (sharedPool) {
+            sharedPool->submit(this, totalBlocks);
+        }
+        
+        // A nested caller occupies a worker, it computes its own blocks so that they do not wait for one
+        if (jobNestingDepth() > 0) {
+            helpWithJobsOf(computationId, std::chrono::steady_clock::time_point::max());
+        }
+        
+        // Wait for all jobs of this computation to complete. Those still running are in the hands of threads
+        // that are computing, so this cannot deadlock even when nested.
+        buffer->waitAllJobsDone(computationId);
+        
+        // Give back the threads that are no longer needed
+        autoScale(0);
+    }
+    
+    ///
+    /// \brief Computes the queued blocks of a computation in the calling thread
+    /// \param computationId The ID of the computation
+    /// \param deadline Time at which to stop helping
+    ///
+    void helpWithJobsOf(int computationId, std::chrono::steady_clock::time_point deadline)
+    {
+        TileJob<T> job;
+        while (std::chrono::steady_clock::now() < deadline && buffer->tryGetJobOf(computationId, job)) {
+            computeBlock(job);
+            buffer->jobCompleted(job);
+        }
+    }
+    
+    ///
+    /// \brief Computes C = A * B if the queue has room for it before a deadline
+    /// \return true once the product is computed, false if it was rejected
+    ///
+    /// The Hoare monitor offers no timed wait, so the admission is retried with a growing sleep in between.
+    ///
+    bool multiplyUntil(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C, int nbBlocksPerRow,
+                       std::chrono::steady_clock::time_point deadline)
+    {
+        int totalBlocks = nbBlocksPerRow * nbBlocksPerRow;
+        autoScale(totalBlocks);
+        
+        ComputeParameters<T> params = makeParameters(A, B, C, nbBlocksPerRow);
+        int computationId;
+        uint64_t sleepUs = 20;
+        while (!buffer->tryStartNewComputation(params, totalBlocks, computationId)) {
+            auto now = std::chrono::steady_clock::now();
+            if (now >= deadline) {
+                buffer->countRejected();
+                return false;
+            }
+            auto left = std::chrono::duration_cast<std::chrono::microseconds>(deadline - now).count();
+            PcoThread::usleep(std::min<uint64_t>(sleepUs, static_cast<uint64_t>(left)));
+            sleepUs = std::min<uint64_t>(sleepUs * 2, 1000);
+        }
+        
+        completeComputation(computationId, totalBlocks);
+        return true;
+    }
+    
+    ///
+    /// \brief Starts or retires threads so that exactly nbThreads run, poolMutex must be held
+    /// \param newNbThreads Number of threads wanted
+    ///
+    void resizePool(int newNbThreads)
+    {
+        if (sharedPool) {
+            return;
+        }
+        if (newNbThreads > nbThreads) {
+            // Allow the new indices before starting the threads so that they do not leave right away
+            buffer->setWorkerCount(newNbThreads);
+            for (int i = nbThreads; i < newNbThreads; ++i) {
+                threads.push_back(std::make_unique<PcoThread>(&ThreadedMatrixMultiplier::workerThread, this, i));
+            }
+        }
+        else if (newNbThreads < nbThreads) {
+            // The workers with the highest indices leave between two jobs
+            buffer->setWorkerCount(newNbThreads);
+            for (int i = newNbThreads; i < nbThreads; ++i) {
+                threads[i]->join();
+            }
+            threads.resize(newNbThreads);
+        }
+        nbThreads = newNbThreads;
+    }
+    
+    ///
+    /// \brief Applies the auto scaling policy, if enabled
+    /// \param nbIncomingJobs Number of jobs about to be sent
+    ///
+    void autoScale(int nbIncomingJobs)
+    {
+        // A worker could have to join itself
+        if (jobNestingDepth() > 0) {
+            return;
+        }
+        poolMutex.lock();
+        if (autoScaling) {
+            int nbQueued;
+            int nbRunning;
+            std::chrono::steady_clock::duration underusedFor;
+            buffer->getLoad(nbQueued, nbRunning, underusedFor);
+            
+            int wanted = std::clamp(nbQueued + nbRunning + nbIncomingJobs,
+                                    autoScalePolicy.minThreads, autoScalePolicy.maxThreads);
+            if (wanted > nbThreads || (wanted < nbThreads && underusedFor >= autoScalePolicy.idleTimeout)) {
+                resizePool(wanted);
+            }
+        }
+        poolMutex.unlock();
+    }
+    
     ///
     /// \brief Worker thread function
+    /// \param workerId Index of the worker in the pool
     /// Continuously retrieves and processes jobs from the buffer
     ///
-    void workerThread()
+    void workerThread(int workerId)
     {
+        TileJob<T> jobs[MAX_COALESCED_JOBS];
         while (true) {
-            ComputeParameters<T> params;
-            
-            // Get a job from the buffer
-            if (!buffer->getJob(params)) {
-                // No more jobs and terminating, exit thread
+            // Get one or more jobs from the buffer
+            int nbJobs = buffer->getJobs(jobs, MAX_COALESCED_JOBS, workerId);
+            if (nbJobs == 0) {
+                // No more jobs and terminating, or retired, exit thread
                 break;
             }
             
-            // Compute the block multiplication
-            computeBlock(params);
+            // Compute the block multiplications
+            jobNestingDepth()++;
+            for (int i = 0; i < nbJobs; ++i) {
+                computeBlock(jobs[i]);
+            }
+            jobNestingDepth()--;
             
-            // Signal job completion for this computation
-            buffer->jobCompleted(params.computationId);
+            // Signal job completion for their computations
+            buffer->jobsCompleted(jobs, nbJobs);
         }
     }
     
     ///
     /// \brief Computes a single block of the matrix multiplication
-    /// \param params Parameters containing the matrices and block indices
+    /// \param job Block indices, and parameters containing the matrices
     ///
     /// Computes C[blockI][blockJ] = sum_k A[blockI][k] * B[k][blockJ]
     /// Each thread computes one complete block, so no race conditions on C elements
     ///
-    void computeBlock(const ComputeParameters<T>& params)
+    void computeBlock(const TileJob<T>& job)
     {
-        const SquareMatrix<T>* A = params.A;
-        const SquareMatrix<T>* B = params.B;
-        SquareMatrix<T>* C = params.C;
-        
-        int n = A->size();
-        int blockSize = n / params.nbBlocksPerRow;
-        int nbBlocksPerRow = params.nbBlocksPerRow;
-        
-        int blockI = params.blockI;
-        int blockJ = params.blockJ;
-        
-        // Compute the complete block C[blockI][blockJ]
-        // For each element (i,j) in the block
-        for (int i = blockI * blockSize; i < (blockI + 1) * blockSize; ++i) {
-            for (int j = blockJ * blockSize; j < (blockJ + 1) * blockSize; ++j) {
-                T sum = 0;
-                
-                // Sum over all K blocks: sum_k A[blockI][k] * B[k][blockJ]
-                for (int blockK = 0; blockK < nbBlocksPerRow; ++blockK) {
-                    for (int k = blockK * blockSize; k < (blockK + 1) * blockSize; ++k) {
-                        sum += A->element(k, i) * B->element(j, k);
-                    }
-                }
-                
-                // Set the result (no race condition as each block is computed by one thread only)
-                C->setElement(j, i, sum);
-            }
+        const ComputeParameters<T>& params = *job.computation;
+        if (params.tileKernel) {
+            params.tileKernel(params.kernelContext, job.blockI, job.blockJ);
+        }
+        else if (params.deterministic) {
+            computeTileDeterministic(*params.A, *params.B, *params.C, params.nbBlocksPerRow, job.blockI, job.blockJ,
+                                     params.accumulate);
+        }
+        else {
+            computeTile(*params.A, *params.B, *params.C, params.nbBlocksPerRow, job.blockI, job.blockJ,
+                        params.accumulate);
+        }
+        // The job is not completed yet, so the parameters are still valid
+        if (params.onTileDone.function) {
+            params.onTileDone.function(params.onTileDone.context, job.blockI, job.blockJ);
         }
     }
 };
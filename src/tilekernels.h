@@ -0,0 +1,107 @@
+#ifndef TILEKERNELS_H
+#define TILEKERNELS_H
+
+///
+/// Tile Kernels
+/// ============
+///
+/// The computation of one block of C = A * B, shared by all the multipliers decomposing the product into
+/// blocks. The multipliers only differ in the way they schedule the blocks.
+///
+
+#include "matrix.h"
+
+
+///
+/// \brief Computes a single block of the matrix multiplication
+/// \param A First matrix
+/// \param B Second matrix
+/// \param C Result of AxB, only the block is written
+/// \param nbBlocksPerRow Number of blocks per row (or columns), must divide the size of the matrices
+/// \param blockI Row of the block
+/// \param blockJ Column of the block
+/// \param accumulate If true, the block is added to C instead of overwriting it
+///
+/// Computes C[blockI][blockJ] = sum_k A[blockI][k] * B[k][blockJ], or C[blockI][blockJ] += the sum
+/// Each block is written by one thread only, so there is no race condition on the elements of C
+///
+template<class T>
+void computeTile(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C, int nbBlocksPerRow,
+                 int blockI, int blockJ, bool accumulate = false)
+{
+    int n = A.size();
+    int blockSize = n / nbBlocksPerRow;
+    
+    // Compute the complete block C[blockI][blockJ]
+    // For each element (i,j) in the block
+    for (int i = blockI * blockSize; i < (blockI + 1) * blockSize; ++i) {
+        for (int j = blockJ * blockSize; j < (blockJ + 1) * blockSize; ++j) {
+            // Accumulating starts from the current element, so that C needs neither a copy nor a second pass
+            T sum = accumulate ? C.element(j, i) : T(0);
+            
+            // Sum over all K blocks: sum_k A[blockI][k] * B[k][blockJ]
+            for (int blockK = 0; blockK < nbBlocksPerRow; ++blockK) {
+                for (int k = blockK * blockSize; k < (blockK + 1) * blockSize; ++k) {
+                    sum += A.element(k, i) * B.element(j, k);
+                }
+            }
+            
+            // Set the result (no race condition as each block is computed by one thread only)
+            C.setElement(j, i, sum);
+        }
+    }
+}
+
+//! Number of consecutive terms summed in order at the leaves of the reduction tree of computeTileDeterministic()
+constexpr int DETERMINISTIC_LEAF_SIZE = 32;
+
+///
+/// \brief Returns sum_{k = first}^{last - 1} A(i, k) * B(k, j) with a reduction tree that only depends on first
+///        and last
+///
+/// The range is split in two halves whose sizes are multiples of DETERMINISTIC_LEAF_SIZE, recursively, and
+/// the leaves are summed in order.
+///
+template<class T>
+T pairwiseDot(const SquareMatrix<T>& A, const SquareMatrix<T>& B, int i, int j, int first, int last)
+{
+    if (last - first <= DETERMINISTIC_LEAF_SIZE) {
+        T sum = 0;
+        for (int k = first; k < last; ++k) {
+            sum += A.element(k, i) * B.element(j, k);
+        }
+        return sum;
+    }
+    int half = ((last - first) / 2 + DETERMINISTIC_LEAF_SIZE - 1) / DETERMINISTIC_LEAF_SIZE * DETERMINISTIC_LEAF_SIZE;
+    return pairwiseDot(A, B, i, j, first, first + half) + pairwiseDot(A, B, i, j, first + half, last);
+}
+
+///
+/// \brief Computes a single block of the matrix multiplication, bitwise reproducibly
+/// \param A First matrix
+/// \param B Second matrix
+/// \param C Result of AxB, only the block is written
+/// \param nbBlocksPerRow Number of blocks per row (or columns), must divide the size of the matrices
+/// \param blockI Row of the block
+/// \param blockJ Column of the block
+/// \param accumulate If true, the block is added to C instead of overwriting it
+///
+/// Each element is reduced over k by the same fixed tree, which only depends on the size of the matrices. The
+/// result is therefore the same whatever the number of blocks, of threads, and the order of the blocks, and
+/// stays so if the kernel is later split along k or vectorized, as long as the tree is kept.
+///
+template<class T>
+void computeTileDeterministic(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C,
+                              int nbBlocksPerRow, int blockI, int blockJ, bool accumulate = false)
+{
+    int n = A.size();
+    int blockSize = n / nbBlocksPerRow;
+    for (int i = blockI * blockSize; i < (blockI + 1) * blockSize; ++i) {
+        for (int j = blockJ * blockSize; j < (blockJ + 1) * blockSize; ++j) {
+            T sum = pairwiseDot(A, B, i, j, 0, n);
+            C.setElement(j, i, accumulate ? C.element(j, i) + sum : sum);
+        }
+    }
+}
+
+#endif // TILEKERNELS_H
@@ -0,0 +1,260 @@
+#ifndef TILESTREAM_H
+#define TILESTREAM_H
+
+///
+/// Streaming of the computed blocks
+/// ================================
+///
+/// A consumer of C, which serializes it or sends it over a socket for instance, does not have to wait for the
+/// whole product: each block can be handed over as soon as it is computed. The blocks are either delivered in
+/// the order they complete, or released by whole row panels, in order, for a consumer that writes C
+/// sequentially. The panel i is then delivered once the panels 0 to i are computed.
+///
+/// The blocks are delivered either to a callback, run by the workers, or to a TileStream that a consumer
+/// thread reads while the workers go on computing.
+///
+
+#include <pcosynchro/pcohoaremonitor.h>
+#include <pcosynchro/pcomutex.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "threadedmatrixmultiplier.h"
+
+
+///
+/// Order in which the computed blocks are delivered
+///
+enum class TileOrder
+{
+    AsCompleted,       // Each block as soon as it is computed
+    RowPanelsInOrder   // Row panel by row panel from the first, the blocks of a panel from the first column
+};
+
+
+///
+/// Turns the completions of the blocks into the release of whole row panels, in order
+///
+class OrderedTileRelease
+{
+public:
+    OrderedTileRelease() = default;
+
+    OrderedTileRelease(const OrderedTileRelease&) = delete;
+    OrderedTileRelease& operator=(const OrderedTileRelease&) = delete;
+
+    ///
+    /// \brief Prepares the release of the blocks of a new product
+    /// \param nbBlocksPerRow Number of blocks per row (or columns) of the product
+    /// \param downstream Called with the blocks released, by one thread at a time
+    ///
+    void reset(int nbBlocksPerRow, const TileCallback& downstream)
+    {
+        if (nbBlocksPerRow != this->nbBlocksPerRow) {
+            nbTilesDone = std::make_unique<std::atomic<int>[]>(nbBlocksPerRow);
+            this->nbBlocksPerRow = nbBlocksPerRow;
+        }
+        for (int i = 0; i < nbBlocksPerRow; ++i) {
+            nbTilesDone[i].store(0, std::memory_order_relaxed);
+        }
+        isPanelDone.assign(nbBlocksPerRow, false);
+        nextPanel = 0;
+        this->downstream = downstream;
+    }
+
+    ///
+    /// \brief Returns the callback to give to the multiplier
+    ///
+    TileCallback callback()
+    {
+        return TileCallback{&OrderedTileRelease::tileDone, this};
+    }
+
+private:
+    int nbBlocksPerRow{0};
+    std::unique_ptr<std::atomic<int>[]> nbTilesDone; // Per row panel, counted without lock
+    std::vector<bool> isPanelDone;                   // Protected by mutex
+    int nextPanel{0};                                // First panel not released yet, protected by mutex
+    TileCallback downstream;
+    PcoMutex mutex;
+
+    static void tileDone(void* context, int blockI, int /*blockJ*/)
+    {
+        auto* release = static_cast<OrderedTileRelease*>(context);
+        int nbBlocksPerRow = release->nbBlocksPerRow;
+        if (release->nbTilesDone[blockI].fetch_add(1, std::memory_order_acq_rel) + 1 < nbBlocksPerRow) {
+            return;
+        }
+        // The panel is complete. The thread completing the next panel to release delivers it, and the
+        // following ones that were waiting for it. The other threads only mark their panel.
+        release->mutex.lock();
+        release->isPanelDone[blockI] = true;
+        while (release->nextPanel < nbBlocksPerRow && release->isPanelDone[release->nextPanel]) {
+            for (int blockJ = 0; blockJ < nbBlocksPerRow; ++blockJ) {
+                release->downstream.function(release->downstream.context, release->nextPanel, blockJ);
+            }
+            release->nextPanel++;
+        }
+        release->mutex.unlock();
+    }
+};
+
+
+///
+/// \brief Computes C = A * B, handing the blocks over to a callback as they are computed
+/// \param multiplier The multiplier computing the product
+/// \param A First matrix
+/// \param B Second matrix
+/// \param C Result of AxB
+/// \param nbBlocksPerRow Number of blocks per row (or columns)
+/// \param onTile Called with the indices of the blocks, by the workers
+/// \param order Order of the calls. With RowPanelsInOrder, the calls are made by one thread at a time.
+///
+template<class T>
+void multiplyStreaming(ThreadedMatrixMultiplier<T>& multiplier, const SquareMatrix<T>& A, const SquareMatrix<T>& B,
+                       SquareMatrix<T>& C, int nbBlocksPerRow, const TileCallback& onTile,
+                       TileOrder order = TileOrder::AsCompleted)
+{
+    if (order == TileOrder::AsCompleted) {
+        multiplier.multiply(A, B, C, nbBlocksPerRow, onTile);
+        return;
+    }
+    OrderedTileRelease release;
+    release.reset(nbBlocksPerRow, onTile);
+    multiplier.multiply(A, B, C, nbBlocksPerRow, release.callback());
+}
+
+
+///
+/// Queue of the blocks of a product computed by a ThreadedMatrixMultiplier, read by one or more consumers:
+///
+///     stream.start(multiplier, A, B, C, nbBlocksPerRow, TileOrder::RowPanelsInOrder);
+///     int blockI, blockJ;
+///     while (stream.pop(blockI, blockJ)) {
+///         send(C, blockI, blockJ);
+///     }
+///
+/// Each block is queued once, so the queue never fills up and the workers never wait for the consumers.
+///
+class TileStream : protected PcoHoareMonitor
+{
+public:
+    TileStream() = default;
+
+    ///
+    /// \brief Waits for the threads that may still be leaving the monitor
+    ///
+    /// The stream must not be destroyed while a product is running, i.e. before pop() returned false.
+    ///
+    ~TileStream()
+    {
+        monitorIn();
+        monitorOut();
+    }
+
+    ///
+    /// \brief Starts a product whose blocks are queued in the stream as they are computed
+    /// \param multiplier The multiplier computing the product
+    /// \param A First matrix
+    /// \param B Second matrix
+    /// \param C Result of AxB
+    /// \param nbBlocksPerRow Number of blocks per row (or columns)
+    /// \param order Order in which the blocks are queued
+    ///
+    /// The previous product of the stream, if any, must be over.
+    ///
+    template<class T>
+    void start(ThreadedMatrixMultiplier<T>& multiplier, const SquareMatrix<T>& A, const SquareMatrix<T>& B,
+               SquareMatrix<T>& C, int nbBlocksPerRow, TileOrder order = TileOrder::AsCompleted)
+    {
+        monitorIn();
+        tiles.resize(nbBlocksPerRow * nbBlocksPerRow);
+        nbPushed = 0;
+        nbPopped = 0;
+        isClosed = false;
+        isCompleted = false;
+        monitorOut();
+
+        TileCallback onTile{&TileStream::tileDone, this};
+        if (order == TileOrder::RowPanelsInOrder) {
+            release.reset(nbBlocksPerRow, onTile);
+            onTile = release.callback();
+        }
+        multiplier.startMultiply(A, B, C, nbBlocksPerRow, CompletionCallback{&TileStream::productDone, this}, onTile);
+    }
+
+    ///
+    /// \brief Takes the next computed block, waiting for it if needed
+    /// \param blockI Set to the row of the block
+    /// \param blockJ Set to the column of the block
+    /// \return false once the product is over and all its blocks were taken
+    ///
+    bool pop(int& blockI, int& blockJ)
+    {
+        monitorIn();
+        while (nbPopped == nbPushed && !isClosed) {
+            wait(tileAvailable);
+        }
+        bool hasTile = nbPopped < nbPushed;
+        if (hasTile) {
+            blockI = tiles[nbPopped].blockI;
+            blockJ = tiles[nbPopped].blockJ;
+            nbPopped++;
+        }
+        else {
+            // Let the other consumers see the end as well
+            signal(tileAvailable);
+        }
+        monitorOut();
+        return hasTile;
+    }
+
+    ///
+    /// \brief Returns true if the last product computed all its blocks, false if it was aborted
+    ///
+    bool isComplete()
+    {
+        monitorIn();
+        bool completed = isCompleted;
+        monitorOut();
+        return completed;
+    }
+
+private:
+    struct TileIndex
+    {
+        int blockI;
+        int blockJ;
+    };
+
+    std::vector<TileIndex> tiles; // Every block of the product, in the order they were queued
+    int nbPushed{0};
+    int nbPopped{0};
+    bool isClosed{false};
+    bool isCompleted{false};
+    Condition tileAvailable;
+    OrderedTileRelease release;
+
+    static void tileDone(void* context, int blockI, int blockJ)
+    {
+        auto* stream = static_cast<TileStream*>(context);
+        stream->monitorIn();
+        stream->tiles[stream->nbPushed++] = {blockI, blockJ};
+        stream->signal(stream->tileAvailable);
+        stream->monitorOut();
+    }
+
+    static void productDone(void* context, bool completed)
+    {
+        auto* stream = static_cast<TileStream*>(context);
+        stream->monitorIn();
+        stream->isClosed = true;
+        stream->isCompleted = completed;
+        stream->signal(stream->tileAvailable);
+        stream->monitorOut();
+    }
+};
+
+#endif // TILESTREAM_H
@@ -0,0 +1,194 @@
+#ifndef TOPKMULTIPLY_H
+#define TOPKMULTIPLY_H
+
+///
+/// Top-k per row of a product
+/// ==========================
+///
+/// A ranking needs only the k largest elements of each row of C = A * B. Instead of writing C, each block
+/// keeps the best elements of each of its rows in a bounded heap of k elements, and merges them into the heap
+/// of the row, shared by the blocks of the row panel. C is never stored: the memory is n * k elements.
+///
+
+#include <pcosynchro/pcomutex.h>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "matrix.h"
+#include "threadedmatrixmultiplier.h"
+
+
+///
+/// An element of a row of C: its column and its value
+///
+template<class T>
+struct TopKEntry
+{
+    int index;
+    T value;
+};
+
+
+///
+/// The k largest elements of each row of a product, by decreasing value then increasing column
+///
+template<class T>
+class TopKResult
+{
+public:
+    TopKResult(int nbRows, int k) : k(k), entries(static_cast<size_t>(nbRows) * k), counts(nbRows, 0) {}
+
+    //! Number of elements kept in a row, k unless the rows are shorter
+    int rowSize(int row) const { return counts[row]; }
+
+    //! The elements kept in a row
+    const TopKEntry<T>* row(int row) const { return entries.data() + static_cast<size_t>(row) * k; }
+
+    int getK() const { return k; }
+
+protected:
+    template<class U>
+    friend TopKResult<U> multiplyTopK(ThreadedMatrixMultiplier<U>&, const SquareMatrix<U>&, const SquareMatrix<U>&,
+                                      int);
+    template<class U>
+    friend void computeTopKTile(void*, int, int);
+
+    int k;
+    std::vector<TopKEntry<T>> entries; // k per row, a heap while being filled
+    std::vector<int> counts;
+};
+
+
+///
+/// \brief Orders the elements of a row, the best first
+///
+/// A NaN is worse than any number, so that the order stays a strict weak ordering, as the heaps require.
+///
+template<class T>
+bool isBetterEntry(const TopKEntry<T>& a, const TopKEntry<T>& b)
+{
+    if constexpr (std::is_floating_point_v<T>) {
+        bool isANaN = std::isnan(a.value);
+        bool isBNaN = std::isnan(b.value);
+        if (isANaN || isBNaN) {
+            return isANaN != isBNaN ? isBNaN : a.index < b.index;
+        }
+    }
+    return a.value > b.value || (a.value == b.value && a.index < b.index);
+}
+
+///
+/// \brief Adds an element to a bounded heap whose top is the worst element kept
+/// \param heap The heap, of capacity k
+/// \param size Number of elements in the heap, updated
+/// \param k Capacity of the heap
+/// \param entry Element to add, dropped if worse than the k kept
+///
+template<class T>
+void pushBounded(TopKEntry<T>* heap, int& size, int k, const TopKEntry<T>& entry)
+{
+    if (size < k) {
+        heap[size++] = entry;
+        std::push_heap(heap, heap + size, isBetterEntry<T>);
+    }
+    else if (isBetterEntry(entry, heap[0])) {
+        std::pop_heap(heap, heap + size, isBetterEntry<T>);
+        heap[size - 1] = entry;
+        std::push_heap(heap, heap + size, isBetterEntry<T>);
+    }
+}
+
+
+///
+/// A top-k product, shared by all its blocks
+///
+template<class T>
+struct TopKProduct
+{
+    const SquareMatrix<T>* A;
+    const SquareMatrix<T>* B;
+    TopKResult<T>* result;
+    int blockSize;
+    std::unique_ptr<PcoMutex[]> panelLocks; // Protect the heaps of the rows of a row panel
+};
+
+
+///
+/// \brief Computes the block (blockI, blockJ) of the product and merges its best elements into the rows
+/// \param context The TopKProduct
+///
+template<class T>
+void computeTopKTile(void* context, int blockI, int blockJ)
+{
+    TopKProduct<T>& p = *static_cast<TopKProduct<T>*>(context);
+    TopKResult<T>& result = *p.result;
+    int n = p.A->size();
+    int k = result.k;
+    int firstColumn = blockJ * p.blockSize;
+    int lastColumn = std::min(n, firstColumn + p.blockSize);
+    int lastRow = std::min(n, (blockI + 1) * p.blockSize);
+
+    // The heap of the block for one row, merged before the next row. Kept by the worker from one block to the
+    // next, so that it is only allocated by the first product of a worker needing that many elements.
+    thread_local std::vector<TopKEntry<T>> local;
+    int localCapacity = std::min(k, lastColumn - firstColumn);
+    if (static_cast<int>(local.size()) < localCapacity) {
+        local.resize(localCapacity);
+    }
+    for (int i = blockI * p.blockSize; i < lastRow; ++i) {
+        int localSize = 0;
+        for (int j = firstColumn; j < lastColumn; ++j) {
+            T sum = 0;
+            for (int l = 0; l < n; ++l) {
+                sum += p.A->element(l, i) * p.B->element(j, l);
+            }
+            pushBounded(local.data(), localSize, localCapacity, TopKEntry<T>{j, sum});
+        }
+
+        p.panelLocks[blockI].lock();
+        TopKEntry<T>* heap = result.entries.data() + static_cast<size_t>(i) * k;
+        for (int e = 0; e < localSize; ++e) {
+            pushBounded(heap, result.counts[i], k, local[e]);
+        }
+        p.panelLocks[blockI].unlock();
+    }
+}
+
+
+///
+/// \brief Computes the k largest elements of each row of A * B, without storing A * B
+/// \param engine The multiplier whose pool computes the blocks
+/// \param A First matrix
+/// \param B Second matrix
+/// \param k Number of elements kept per row
+/// \return The elements kept, by decreasing value then increasing column in each row
+///
+template<class T>
+TopKResult<T> multiplyTopK(ThreadedMatrixMultiplier<T>& engine, const SquareMatrix<T>& A, const SquareMatrix<T>& B,
+                           int k)
+{
+    int n = A.size();
+    TopKResult<T> result(n, std::max(k, 0));
+    if (n == 0 || k <= 0) {
+        return result;
+    }
+
+    int nbBlocksPerRow = engine.chooseBlocksPerRow(static_cast<long long>(n) * n);
+    TopKProduct<T> product{&A, &B, &result, (n + nbBlocksPerRow - 1) / nbBlocksPerRow,
+                           std::make_unique<PcoMutex[]>(nbBlocksPerRow)};
+    long long tileWork = static_cast<long long>(product.blockSize) * product.blockSize * n;
+    engine.runTiles(nbBlocksPerRow, &computeTopKTile<T>, &product, tileWork);
+
+    // The heaps become sorted rows
+    for (int i = 0; i < n; ++i) {
+        TopKEntry<T>* heap = result.entries.data() + static_cast<size_t>(i) * result.k;
+        std::sort_heap(heap, heap + result.counts[i], isBetterEntry<T>);
+    }
+    return result;
+}
+
+#endif // TOPKMULTIPLY_H
@@ -0,0 +1,289 @@
+#ifndef VERIFIEDMULTIPLY_H
+#define VERIFIEDMULTIPLY_H
+
+///
+/// Checksum-verified product (algorithm-based fault tolerance)
+/// ===========================================================
+///
+/// Checking C = A * B by recomputing it costs as much as the product. The sums of the rows and of the columns
+/// of a block of C can however be predicted from the operands:
+///
+///     sum_{j in J} C(i, j) = sum_k A(i, k) * (sum_{j in J} B(k, j))
+///     sum_{i in I} C(i, j) = sum_k (sum_{i in I} A(i, k)) * B(k, j)
+///
+/// The sums of B over each column panel and of A over each row panel are computed once, in n * n operations.
+/// The predicted sums of the rows and columns of every block follow, once and before the product, as jobs of
+/// their own: 2 * nbBlocksPerRow * n * n operations, against n * n * n for the product. Each block then sums
+/// its elements by row and by column, in blockSize * blockSize operations, compares these 2 * blockSize sums
+/// with the predicted ones, and is recomputed if they do not match. A retry does not predict anything again.
+///
+/// For floating-point types, a mismatch is tolerated within the rounding errors of T, so a corruption is
+/// detected when it changes a sum by more than about n * epsilon times the sum of its absolute values.
+/// Integer products are checked exactly, with sums modulo 2^bits like the arithmetic of C itself, so that a
+/// product that overflows is not reported as corrupted.
+///
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include "matrix.h"
+#include "threadedmatrixmultiplier.h"
+#include "tilekernels.h"
+
+
+///
+/// Function called after each computation of a block and before its verification, to simulate faults
+///
+template<class T>
+struct FaultInjector
+{
+    void (*function)(void* context, SquareMatrix<T>& C, int blockI, int blockJ, int attempt){nullptr};
+    void* context{nullptr};
+};
+
+
+///
+/// What a verified product detected
+///
+struct VerificationReport
+{
+    int nbCorruptedTiles{0};    // Blocks whose checksums failed at least once
+    int nbRetries{0};           // Recomputations of blocks
+    int nbUnrecoveredTiles{0};  // Blocks still failing after the last retry, C is then wrong
+};
+
+
+///
+/// Type of the checksums of a product of T: double for floating-point types, and for integers the unsigned
+/// type of the same size, whose sums wrap around like those of the product
+///
+template<class T>
+using ChecksumType = typename std::conditional_t<std::is_integral_v<T>, std::make_unsigned<T>,
+                                                 std::type_identity<double>>::type;
+
+
+///
+/// A verified product, shared by all its blocks
+///
+template<class T>
+struct VerifiedProduct
+{
+    using Sum = ChecksumType<T>;
+
+    const SquareMatrix<T>* A;
+    const SquareMatrix<T>* B;
+    SquareMatrix<T>* C;
+    int nbBlocksPerRow;
+    int blockSize;
+    int maxRetries;
+    FaultInjector<T> injector;
+    double tolerance;                     // Relative to the sums of absolute values, 0 for integers
+
+    // Per panel, n values each: sum_{j in J} B(k, j) and sum_{i in I} A(i, k), and the same with absolute values
+    std::vector<Sum> bPanelSums;
+    std::vector<double> bPanelAbsSums;
+    std::vector<Sum> aPanelSums;
+    std::vector<double> aPanelAbsSums;
+
+    // Predicted sum of the row i over the column panel J at i * nbBlocksPerRow + J, and of the column j over the
+    // row panel I at I * n + j, with the sums of absolute values bounding their rounding errors
+    std::vector<Sum> rowSums;
+    std::vector<double> rowBounds;
+    std::vector<Sum> columnSums;
+    std::vector<double> columnBounds;
+
+    // Sums of the columns of each block while it is checked, at the same index as columnSums
+    std::vector<Sum> actualColumnSums;
+
+    std::atomic<int> nbCorruptedTiles{0};
+    std::atomic<int> nbRetries{0};
+    std::atomic<int> nbUnrecoveredTiles{0};
+};
+
+
+///
+/// \brief Tells whether a sum of a block matches its prediction
+///
+template<class T>
+bool sumMatches(ChecksumType<T> actual, ChecksumType<T> expected, double bound, double tolerance)
+{
+    if constexpr (std::is_integral_v<T>) {
+        return actual == expected;
+    }
+    else {
+        // Written so that a NaN fails
+        return std::abs(actual - expected) <= tolerance * bound;
+    }
+}
+
+
+///
+/// \brief Predicts the sums of the rows and of the columns of the block (blockI, blockJ)
+/// \param context The VerifiedProduct
+///
+template<class T>
+void computeChecksumTile(void* context, int blockI, int blockJ)
+{
+    using Sum = ChecksumType<T>;
+    VerifiedProduct<T>& p = *static_cast<VerifiedProduct<T>*>(context);
+    int n = p.A->size();
+    const Sum* bSums = p.bPanelSums.data() + static_cast<size_t>(blockJ) * n;
+    const double* bAbsSums = p.bPanelAbsSums.data() + static_cast<size_t>(blockJ) * n;
+    const Sum* aSums = p.aPanelSums.data() + static_cast<size_t>(blockI) * n;
+    const double* aAbsSums = p.aPanelAbsSums.data() + static_cast<size_t>(blockI) * n;
+
+    for (int i = blockI * p.blockSize; i < (blockI + 1) * p.blockSize; ++i) {
+        Sum expected = 0;
+        double bound = 0;
+        for (int k = 0; k < n; ++k) {
+            T a = p.A->element(k, i);
+            expected += static_cast<Sum>(a) * bSums[k];
+            bound += std::abs(static_cast<double>(a)) * bAbsSums[k];
+        }
+        p.rowSums[static_cast<size_t>(i) * p.nbBlocksPerRow + blockJ] = expected;
+        p.rowBounds[static_cast<size_t>(i) * p.nbBlocksPerRow + blockJ] = bound;
+    }
+    for (int j = blockJ * p.blockSize; j < (blockJ + 1) * p.blockSize; ++j) {
+        Sum expected = 0;
+        double bound = 0;
+        for (int k = 0; k < n; ++k) {
+            T b = p.B->element(j, k);
+            expected += aSums[k] * static_cast<Sum>(b);
+            bound += aAbsSums[k] * std::abs(static_cast<double>(b));
+        }
+        p.columnSums[static_cast<size_t>(blockI) * n + j] = expected;
+        p.columnBounds[static_cast<size_t>(blockI) * n + j] = bound;
+    }
+}
+
+
+///
+/// \brief Checks the row and column sums of a block of C against their predictions
+/// \return true if they match
+///
+template<class T>
+bool checkTile(VerifiedProduct<T>& p, int blockI, int blockJ)
+{
+    using Sum = ChecksumType<T>;
+    int n = p.A->size();
+    int firstRow = blockI * p.blockSize;
+    int firstColumn = blockJ * p.blockSize;
+    Sum* actualColumnSums = p.actualColumnSums.data() + static_cast<size_t>(blockI) * n;
+
+    bool matches = true;
+    std::fill(actualColumnSums + firstColumn, actualColumnSums + firstColumn + p.blockSize, Sum(0));
+    for (int i = firstRow; i < firstRow + p.blockSize; ++i) {
+        Sum actual = 0;
+        for (int j = firstColumn; j < firstColumn + p.blockSize; ++j) {
+            Sum element = static_cast<Sum>(p.C->element(j, i));
+            actual += element;
+            actualColumnSums[j] += element;
+        }
+        size_t index = static_cast<size_t>(i) * p.nbBlocksPerRow + blockJ;
+        matches = matches && sumMatches<T>(actual, p.rowSums[index], p.rowBounds[index], p.tolerance);
+    }
+    for (int j = firstColumn; j < firstColumn + p.blockSize && matches; ++j) {
+        size_t index = static_cast<size_t>(blockI) * n + j;
+        matches = sumMatches<T>(actualColumnSums[j], p.columnSums[index], p.columnBounds[index], p.tolerance);
+    }
+    return matches;
+}
+
+
+///
+/// \brief Computes a block of C and checks it, recomputing it while its checksums fail
+/// \param context The VerifiedProduct
+///
+template<class T>
+void computeVerifiedTile(void* context, int blockI, int blockJ)
+{
+    VerifiedProduct<T>& p = *static_cast<VerifiedProduct<T>*>(context);
+    for (int attempt = 0; attempt <= p.maxRetries; ++attempt) {
+        if (attempt > 0) {
+            p.nbRetries++;
+        }
+        computeTile(*p.A, *p.B, *p.C, p.nbBlocksPerRow, blockI, blockJ);
+        if (p.injector.function) {
+            p.injector.function(p.injector.context, *p.C, blockI, blockJ, attempt);
+        }
+        if (checkTile(p, blockI, blockJ)) {
+            return;
+        }
+        if (attempt == 0) {
+            p.nbCorruptedTiles++;
+        }
+    }
+    p.nbUnrecoveredTiles++;
+}
+
+
+///
+/// \brief Computes C = A * B, checking each block against checksums of A and B and recomputing the failing ones
+/// \param engine The multiplier whose pool computes the blocks
+/// \param A First matrix
+/// \param B Second matrix
+/// \param C Result of AxB
+/// \param nbBlocksPerRow Number of blocks per row (or columns), must divide the size of the matrices
+/// \param maxRetries Number of recomputations of a failing block before giving up on it
+/// \param injector Optional fault injection, for testing
+/// \return The blocks found corrupted, and those that could not be recovered
+///
+template<class T>
+VerificationReport multiplyVerified(ThreadedMatrixMultiplier<T>& engine, const SquareMatrix<T>& A,
+                                    const SquareMatrix<T>& B, SquareMatrix<T>& C, int nbBlocksPerRow,
+                                    int maxRetries = 2, const FaultInjector<T>& injector = {})
+{
+    using Sum = ChecksumType<T>;
+    int n = A.size();
+    VerifiedProduct<T> p;
+    p.A = &A;
+    p.B = &B;
+    p.C = &C;
+    p.nbBlocksPerRow = nbBlocksPerRow;
+    p.blockSize = n / nbBlocksPerRow;
+    p.maxRetries = maxRetries;
+    p.injector = injector;
+    // Each element of C carries up to n roundings, the sums of a block add blockSize more
+    p.tolerance = 2.0 * (n + p.blockSize + 1) * static_cast<double>(std::numeric_limits<T>::epsilon());
+
+    size_t panelValues = static_cast<size_t>(nbBlocksPerRow) * n;
+    p.bPanelSums.assign(panelValues, Sum(0));
+    p.bPanelAbsSums.assign(panelValues, 0.0);
+    p.aPanelSums.assign(panelValues, Sum(0));
+    p.aPanelAbsSums.assign(panelValues, 0.0);
+    for (int y = 0; y < n; ++y) {
+        for (int x = 0; x < n; ++x) {
+            // B(y, x) adds to the sums of its column panel, A(y, x) to those of its row panel
+            T b = B.element(x, y);
+            size_t bIndex = static_cast<size_t>(x / p.blockSize) * n + y;
+            p.bPanelSums[bIndex] += static_cast<Sum>(b);
+            p.bPanelAbsSums[bIndex] += std::abs(static_cast<double>(b));
+            T a = A.element(x, y);
+            size_t aIndex = static_cast<size_t>(y / p.blockSize) * n + x;
+            p.aPanelSums[aIndex] += static_cast<Sum>(a);
+            p.aPanelAbsSums[aIndex] += std::abs(static_cast<double>(a));
+        }
+    }
+
+    p.rowSums.assign(panelValues, Sum(0));
+    p.rowBounds.assign(panelValues, 0.0);
+    p.columnSums.assign(panelValues, Sum(0));
+    p.columnBounds.assign(panelValues, 0.0);
+    p.actualColumnSums.assign(panelValues, Sum(0));
+    engine.runTiles(nbBlocksPerRow, &computeChecksumTile<T>, &p, 2LL * p.blockSize * n);
+
+    long long tileWork = static_cast<long long>(p.blockSize) * (p.blockSize * n + p.blockSize);
+    engine.runTiles(nbBlocksPerRow, &computeVerifiedTile<T>, &p, tileWork);
+
+    VerificationReport report;
+    report.nbCorruptedTiles = p.nbCorruptedTiles.load();
+    report.nbRetries = p.nbRetries.load();
+    report.nbUnrecoveredTiles = p.nbUnrecoveredTiles.load();
+    return report;
+}
+
+#endif // VERIFIEDMULTIPLY_H
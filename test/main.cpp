@@ -1,15 +1,93 @@
 #include <gtest/gtest.h>
 #include <pcosynchro/pcotest.h>
 
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "approximatemultiply.h"
+#include "automatrixmultiplier.h"
+#include "cachingmatrixmultiplier.h"
+#include "checkpointedmultiply.h"
+#include "maskedmultiply.h"
+#include "matrixexpression.h"
+#include "multiplyawaitable.h"
 #include "multipliertester.h"
 #include "multiplierthreadedtester.h"
+#include "openmpmatrixmultiplier.h"
+#include "pcoblas.h"
+#include "stdparmatrixmultiplier.h"
 #include "threadedmatrixmultiplier.h"
+#include "tilestream.h"
+#include "topkmultiply.h"
+#include "verifiedmultiply.h"
 
 #define ThreadedMultiplierType ThreadedMatrixMultiplier<float>
 
 // Decommenting the next line allows to check for interlocking
 #define CHECK_DURATION
 
+//! Number of heap allocations done by the whole process, see the replacement operator new below
+static std::atomic<long long> nbAllocations{ 0 };
+
+void *
+operator new (std::size_t size)
+{
+  nbAllocations.fetch_add (1, std::memory_order_relaxed);
+  if (void *pointer = std::malloc (size == 0 ? 1 : size)) {
+      return pointer;
+  }
+  throw std::bad_alloc ();
+}
+
+__attribute__ ((noinline)) void
+operator delete (void *pointer) noexcept
+{
+  std::free (pointer);
+}
+
+__attribute__ ((noinline)) void
+operator delete (void *pointer, std::size_t) noexcept
+{
+  std::free (pointer);
+}
+
+///
+/// Fills A and B with random values and computes the reference product in C_ref
+///
+template<class T>
+void prepareMatrices(SquareMatrix<T>& A, SquareMatrix<T>& B, SquareMatrix<T>& C_ref)
+{
+  for (int i = 0; i < A.size(); i++) {
+      for (int j = 0; j < A.size(); j++) {
+          A.setElement(i, j, rand());
+          B.setElement(i, j, rand());
+      }
+  }
+  SimpleMatrixMultiplier<T> multiplier;
+  multiplier.multiply(A, B, C_ref);
+}
+
+///
+/// Returns true if both matrices hold exactly the same elements
+///
+template<class T>
+bool sameMatrices(const Matrix<T>& M1, const Matrix<T>& M2)
+{
+  for (int x = 0; x < M1.getSizeX(); x++) {
+      for (int y = 0; y < M1.getSizeY(); y++) {
+          if (M1.element(x, y) != M2.element(x, y)) {
+              return false;
+          }
+      }
+  }
+  return true;
+}
+
 TEST (Multiplier, SingleThread){
 
 #ifdef CHECK_DURATION
@@ -272,6 +350,1555 @@ TEST (Multiplier, FewThreadsManyBlocks)
 #endif // CHECK_DURATION
 }
 
+// Resizing the pool between computations
+TEST (Multiplier, ResizePool)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 300;
+                        SquareMatrix<float> A (MATRIXSIZE), B (MATRIXSIZE),
+                            C (MATRIXSIZE), C_ref (MATRIXSIZE);
+                        prepareMatrices (A, B, C_ref);
+
+                        ThreadedMultiplierType multiplier (2, 5);
+                        for (int nbThreads : { 6, 1, 3 }) {
+                            multiplier.setThreadCount (nbThreads);
+                            EXPECT_EQ (multiplier.getThreadCount (), nbThreads);
+                            multiplier.multiply (A, B, C);
+                            EXPECT_TRUE (sameMatrices (C, C_ref));
+                        }
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+// Resizing the pool while computations are in progress
+TEST (Multiplier, ResizeWhileComputing)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 400;
+                        SquareMatrix<float> A (MATRIXSIZE), B (MATRIXSIZE),
+                            C (MATRIXSIZE), C_ref (MATRIXSIZE);
+                        prepareMatrices (A, B, C_ref);
+
+                        ThreadedMultiplierType multiplier (4, 10);
+                        PcoThread caller ([&] () { multiplier.multiply (A, B, C); });
+                        multiplier.setThreadCount (1);
+                        multiplier.setThreadCount (8);
+                        multiplier.setThreadCount (2);
+                        caller.join ();
+                        EXPECT_TRUE (sameMatrices (C, C_ref));
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+// Automatic growth on a burst, and shrink once the pool stays idle
+TEST (Multiplier, AutoScaling)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 200;
+                        SquareMatrix<float> A (MATRIXSIZE), B (MATRIXSIZE),
+                            C (MATRIXSIZE), C_ref (MATRIXSIZE);
+                        prepareMatrices (A, B, C_ref);
+
+                        ThreadedMultiplierType multiplier (1);
+                        multiplier.enableAutoScaling ({ 1, 4, std::chrono::milliseconds (200) });
+
+                        // 25 jobs, the pool grows to its maximum right away
+                        multiplier.multiply (A, B, C, 5);
+                        EXPECT_TRUE (sameMatrices (C, C_ref));
+                        EXPECT_EQ (multiplier.getThreadCount (), 4);
+
+                        PcoThread::usleep (300000);
+                        multiplier.multiply (A, B, C, 1);
+                        EXPECT_TRUE (sameMatrices (C, C_ref));
+                        EXPECT_EQ (multiplier.getThreadCount (), 1);
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+// Several multipliers of different element types sharing one pool
+TEST (Multiplier, SharedPool)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 300;
+                        SquareMatrix<float> A (MATRIXSIZE), B (MATRIXSIZE),
+                            C (MATRIXSIZE), C_ref (MATRIXSIZE);
+                        SquareMatrix<double> Ad (MATRIXSIZE), Bd (MATRIXSIZE),
+                            Cd (MATRIXSIZE), Cd_ref (MATRIXSIZE);
+                        prepareMatrices (A, B, C_ref);
+                        prepareMatrices (Ad, Bd, Cd_ref);
+
+                        SharedWorkerPool pool (3);
+                        ThreadedMatrixMultiplier<float> floatMultiplier (pool, 5);
+                        ThreadedMatrixMultiplier<double> doubleMultiplier (pool, 10);
+                        EXPECT_EQ (floatMultiplier.getThreadCount (), 3);
+
+                        PcoThread caller ([&] () { doubleMultiplier.multiply (Ad, Bd, Cd); });
+                        floatMultiplier.multiply (A, B, C);
+                        caller.join ();
+
+                        EXPECT_TRUE (sameMatrices (C, C_ref));
+                        EXPECT_TRUE (sameMatrices (Cd, Cd_ref));
+                        EXPECT_EQ (floatMultiplier.getSharedPoolStats ().nbSubmitted, 25);
+                        EXPECT_EQ (doubleMultiplier.getSharedPoolStats ().nbSubmitted, 100);
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+// Reentrant calls on the process-wide pool
+TEST (Multiplier, SharedPoolReentering)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 300;
+                        constexpr int NBBLOCKSPERROW = 5;
+                        ThreadedMultiplierType multiplier (SharedWorkerPool::instance ());
+
+                        std::vector<std::unique_ptr<PcoThread>> callers;
+                        for (int i = 0; i < 4; i++) {
+                            callers.push_back (std::make_unique<PcoThread> (
+                                test_int<ThreadedMultiplierType>, MATRIXSIZE,
+                                NBBLOCKSPERROW, &multiplier));
+                        }
+                        for (auto &caller : callers) {
+                            caller->join ();
+                        }
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+// Tail latency of small multiplications for each idle strategy
+TEST (Multiplier, IdleStrategies)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 64;
+                        constexpr int NBTHREADS = 2;
+                        constexpr int NBBLOCKSPERROW = 2;
+                        constexpr int NBITERATIONS = 300;
+                        SquareMatrix<float> A (MATRIXSIZE), B (MATRIXSIZE),
+                            C (MATRIXSIZE), C_ref (MATRIXSIZE);
+                        prepareMatrices (A, B, C_ref);
+
+                        std::vector<std::pair<const char *, IdleStrategy>> strategies{
+                            { "park", IdleStrategy::park () },
+                            { "spin-then-park", IdleStrategy::spinThenPark () }
+                        };
+                        for (auto &[name, strategy] : strategies) {
+                            ThreadedMultiplierType multiplier (NBTHREADS, NBBLOCKSPERROW);
+                            multiplier.setIdleStrategy (strategy);
+
+                            for (int i = 0; i < NBITERATIONS; i++) {
+                                multiplier.multiply (A, B, C);
+                                ASSERT_TRUE (sameMatrices (C, C_ref)) << "Idle strategy " << name;
+                            }
+                        }
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+// Teardown of a pool bigger than any fixed wake up count
+TEST (Multiplier, LargePoolTeardown)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 200;
+                        constexpr int NBTHREADS = 300;
+                        constexpr int NBBLOCKSPERROW = 10;
+
+                        MultiplierTester<ThreadedMultiplierType> tester;
+
+                        tester.test (MATRIXSIZE, NBTHREADS, NBBLOCKSPERROW);
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+// Frequent creation and destruction of pools
+TEST (Multiplier, RepeatedTeardown)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 200;
+                        SquareMatrix<float> A (MATRIXSIZE), B (MATRIXSIZE),
+                            C (MATRIXSIZE), C_ref (MATRIXSIZE);
+                        prepareMatrices (A, B, C_ref);
+
+                        for (int i = 0; i < 50; i++) {
+                            ThreadedMultiplierType multiplier (8, 4);
+                            multiplier.multiply (A, B, C);
+                            EXPECT_TRUE (sameMatrices (C, C_ref));
+                        }
+                        for (int i = 0; i < 50; i++) {
+                            ThreadedMultiplierType multiplier (64);
+                        }
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+// Once warmed up, multiply() does not allocate on the heap
+TEST (Multiplier, NoAllocationPerMultiply)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 100;
+                        SquareMatrix<float> A (MATRIXSIZE), B (MATRIXSIZE),
+                            C (MATRIXSIZE), C_ref (MATRIXSIZE);
+                        prepareMatrices (A, B, C_ref);
+
+                        ThreadedMultiplierType multiplier (4, 5);
+                        multiplier.multiply (A, B, C);
+
+                        long long before = nbAllocations.load ();
+                        for (int i = 0; i < 100; i++) {
+                            multiplier.multiply (A, B, C);
+                        }
+                        long long after = nbAllocations.load ();
+
+                        EXPECT_EQ (after - before, 0);
+                        EXPECT_TRUE (sameMatrices (C, C_ref));
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+// Many callers submitting tiny computations, with and without coalescing
+TEST (Multiplier, CoalescedSmallComputations)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 64;
+                        constexpr int NBTHREADS = 4;
+                        constexpr int NBBLOCKSPERROW = 4;
+                        constexpr int NBCALLERS = 8;
+                        constexpr int NBITERATIONS = 50;
+                        SquareMatrix<float> A (MATRIXSIZE), B (MATRIXSIZE), C_ref (MATRIXSIZE);
+                        prepareMatrices (A, B, C_ref);
+
+                        for (long long budget : { 0LL, Buffer<float>::DEFAULT_COALESCING_BUDGET }) {
+                            ThreadedMultiplierType multiplier (NBTHREADS, NBBLOCKSPERROW);
+                            multiplier.setCoalescingBudget (budget);
+
+                            std::atomic<int> nbErrors{ 0 };
+                            std::vector<std::unique_ptr<PcoThread>> callers;
+                            for (int i = 0; i < NBCALLERS; i++) {
+                                callers.push_back (std::make_unique<PcoThread> ([&] () {
+                                    SquareMatrix<float> C (MATRIXSIZE);
+                                    for (int j = 0; j < NBITERATIONS; j++) {
+                                        multiplier.multiply (A, B, C);
+                                        if (!sameMatrices (C, C_ref)) {
+                                            nbErrors++;
+                                        }
+                                    }
+                                }));
+                            }
+                            for (auto &caller : callers) {
+                                caller->join ();
+                            }
+
+                            EXPECT_EQ (nbErrors.load (), 0) << "Coalescing budget " << budget;
+                        }
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+// Bounded queue: rejected and timed out submissions leave C untouched
+TEST (Multiplier, Backpressure)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 500;
+                        constexpr int NBBLOCKSPERROW = 5;
+                        SquareMatrix<float> A (MATRIXSIZE), B (MATRIXSIZE),
+                            C1 (MATRIXSIZE), C2 (MATRIXSIZE), C_ref (MATRIXSIZE);
+                        prepareMatrices (A, B, C_ref);
+
+                        ThreadedMultiplierType multiplier (1, NBBLOCKSPERROW);
+                        multiplier.setQueueCapacity (10);
+
+                        // Admitted although bigger than the capacity, since the queue is empty
+                        PcoThread caller ([&] () { multiplier.multiply (A, B, C1); });
+                        while (multiplier.getQueueMetrics ().nbQueuedJobs == 0) {
+                            PcoThread::usleep (100);
+                        }
+
+                        EXPECT_FALSE (multiplier.tryMultiply (A, B, C2, NBBLOCKSPERROW));
+                        EXPECT_FALSE (multiplier.multiplyFor (A, B, C2, NBBLOCKSPERROW, std::chrono::milliseconds (1)));
+                        QueueMetrics metrics = multiplier.getQueueMetrics ();
+                        EXPECT_EQ (metrics.maxQueuedJobs, 10);
+                        EXPECT_EQ (metrics.nbRejected, 2);
+                        EXPECT_GT (metrics.nbQueuedWork, 0);
+                        EXPECT_EQ (C2.element (0, 0), 0);
+
+                        // Waits for room, then computes
+                        multiplier.multiply (A, B, C2);
+                        caller.join ();
+                        EXPECT_TRUE (sameMatrices (C1, C_ref));
+                        EXPECT_TRUE (sameMatrices (C2, C_ref));
+                        EXPECT_EQ (multiplier.getQueueMetrics ().nbAdmitted, 2);
+
+                        EXPECT_TRUE (multiplier.multiplyFor (A, B, C2, NBBLOCKSPERROW, std::chrono::seconds (10)));
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+// Earliest deadline first, and cancellation of the remaining blocks on timeout
+TEST (Multiplier, Deadlines)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 500;
+                        constexpr int NBBLOCKSPERROW = 5;
+                        SquareMatrix<float> A (MATRIXSIZE), B (MATRIXSIZE),
+                            C1 (MATRIXSIZE), C2 (MATRIXSIZE), C_ref (MATRIXSIZE);
+                        prepareMatrices (A, B, C_ref);
+                        SquareMatrix<float> smallA (50), smallB (50), smallC (50), smallC_ref (50);
+                        prepareMatrices (smallA, smallB, smallC_ref);
+
+                        ThreadedMultiplierType multiplier (1, NBBLOCKSPERROW);
+                        auto now = std::chrono::steady_clock::now ();
+
+                        // The urgent computation overtakes the queued blocks of the first one
+                        int background = multiplier.startMultiply (A, B, C1, NBBLOCKSPERROW);
+                        int urgent = multiplier.startMultiply (smallA, smallB, smallC, 1, now + std::chrono::seconds (10));
+                        EXPECT_TRUE (multiplier.waitUntil (urgent, now + std::chrono::seconds (10)));
+                        EXPECT_TRUE (sameMatrices (smallC, smallC_ref));
+                        EXPECT_FALSE (multiplier.waitUntil (background, std::chrono::steady_clock::now ()));
+                        EXPECT_TRUE (multiplier.waitUntil (background, std::chrono::steady_clock::time_point::max ()));
+                        EXPECT_TRUE (sameMatrices (C1, C_ref));
+
+                        // Far too short deadline, the remaining blocks are cancelled
+                        now = std::chrono::steady_clock::now ();
+                        EXPECT_EQ (multiplier.multiply (A, B, C2, NBBLOCKSPERROW, now + std::chrono::milliseconds (1)),
+                                   MultiplyStatus::TimedOut);
+                        EXPECT_EQ (multiplier.getQueueMetrics ().nbQueuedJobs, 0);
+
+                        now = std::chrono::steady_clock::now ();
+                        EXPECT_EQ (multiplier.multiply (A, B, C2, NBBLOCKSPERROW, now + std::chrono::seconds (20)),
+                                   MultiplyStatus::Completed);
+                        EXPECT_TRUE (sameMatrices (C2, C_ref));
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+///
+/// Jobs of a shared pool that each compute a product with a multiplier running on the same pool
+///
+class NestedProducts : public SharedWorkerPool::Client
+{
+public:
+  NestedProducts (ThreadedMultiplierType &multiplier, const SquareMatrix<float> &A,
+                  const SquareMatrix<float> &B, std::vector<SquareMatrix<float>> &results)
+      : multiplier (multiplier), A (A), B (B), results (results)
+  {
+  }
+
+  bool
+  runPendingJob () override
+  {
+    int index = nbStarted++;
+    multiplier.multiply (A, B, results[index], 5);
+    nbDone++;
+    return true;
+  }
+
+  std::atomic<int> nbStarted{ 0 };
+  std::atomic<int> nbDone{ 0 };
+
+private:
+  ThreadedMultiplierType &multiplier;
+  const SquareMatrix<float> &A;
+  const SquareMatrix<float> &B;
+  std::vector<SquareMatrix<float>> &results;
+};
+
+// multiply() called from the workers themselves, with every worker busy with a nested call
+TEST (Multiplier, NestedMultiply)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 200;
+                        constexpr int NBPRODUCTS = 6;
+                        SquareMatrix<float> A (MATRIXSIZE), B (MATRIXSIZE), C_ref (MATRIXSIZE);
+                        prepareMatrices (A, B, C_ref);
+                        std::vector<SquareMatrix<float>> results (NBPRODUCTS, SquareMatrix<float> (MATRIXSIZE));
+
+                        SharedWorkerPool pool (2);
+                        ThreadedMultiplierType multiplier (pool);
+                        multiplier.setQueueCapacity (10);
+                        NestedProducts products (multiplier, A, B, results);
+                        pool.registerClient (&products);
+                        pool.submit (&products, NBPRODUCTS);
+
+                        while (products.nbDone < NBPRODUCTS) {
+                            PcoThread::usleep (1000);
+                        }
+                        pool.unregisterClient (&products);
+
+                        for (auto &C : results) {
+                            EXPECT_TRUE (sameMatrices (C, C_ref));
+                        }
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+// Products whose operands are the results of products still running
+TEST (Multiplier, DataflowChain)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 200;
+                        constexpr int NBBLOCKSPERROW = 4;
+                        SquareMatrix<double> A (MATRIXSIZE), B (MATRIXSIZE), E (MATRIXSIZE), F (MATRIXSIZE),
+                            AB_ref (MATRIXSIZE), EF_ref (MATRIXSIZE);
+                        prepareMatrices (A, B, AB_ref);
+                        prepareMatrices (E, F, EF_ref);
+                        SimpleMatrixMultiplier<double> simple;
+                        SquareMatrix<double> ABE_ref (MATRIXSIZE), ABEF_ref (MATRIXSIZE), ABAB_ref (MATRIXSIZE);
+                        simple.multiply (AB_ref, E, ABE_ref);
+                        simple.multiply (AB_ref, EF_ref, ABEF_ref);
+                        simple.multiply (AB_ref, AB_ref, ABAB_ref);
+
+                        SharedWorkerPool pool (2);
+                        ThreadedMatrixMultiplier<double> ownThreads (3);
+                        ThreadedMatrixMultiplier<double> onPool (pool);
+                        for (ThreadedMatrixMultiplier<double> *multiplier : { &ownThreads, &onPool }) {
+                            SquareMatrix<double> AB (MATRIXSIZE), EF (MATRIXSIZE), D (MATRIXSIZE);
+
+                            // (A * B) * E
+                            multiplier->multiplyChain (A, B, E, AB, D, NBBLOCKSPERROW);
+                            EXPECT_TRUE (sameMatrices (AB, AB_ref));
+                            EXPECT_TRUE (sameMatrices (D, ABE_ref));
+
+                            // (A * B) * (E * F), each operand has its own producer
+                            int ab = multiplier->startMultiply (A, B, AB, NBBLOCKSPERROW);
+                            int ef = multiplier->startMultiply (E, F, EF, NBBLOCKSPERROW);
+                            int d = multiplier->startMultiplyAfter (AB, EF, D, NBBLOCKSPERROW, ab, ef);
+                            multiplier->wait (d);
+                            multiplier->wait (ab);
+                            multiplier->wait (ef);
+                            EXPECT_TRUE (sameMatrices (D, ABEF_ref));
+
+                            // (A * B) * (A * B) with another blocking, D waits for the whole of AB
+                            ab = multiplier->startMultiply (A, B, AB, NBBLOCKSPERROW);
+                            d = multiplier->startMultiplyAfter (AB, AB, D, 5, ab);
+                            multiplier->wait (ab);
+                            multiplier->wait (d);
+                            EXPECT_TRUE (sameMatrices (D, ABAB_ref));
+
+                            // (A * B) * (E * F) with another blocking than both producers, D waits for both
+                            ab = multiplier->startMultiply (A, B, AB, NBBLOCKSPERROW);
+                            ef = multiplier->startMultiply (E, F, EF, NBBLOCKSPERROW);
+                            d = multiplier->startMultiplyAfter (AB, EF, D, 5, ab, ef);
+                            multiplier->wait (d);
+                            multiplier->wait (ab);
+                            multiplier->wait (ef);
+                            EXPECT_TRUE (sameMatrices (D, ABEF_ref));
+                        }
+
+                        // Cancelling a producer cancels its dependents
+                        ThreadedMatrixMultiplier<double> single (1);
+                        SquareMatrix<double> AB (MATRIXSIZE), D (MATRIXSIZE);
+                        int ab = single.startMultiply (A, B, AB, 10);
+                        int d = single.startMultiplyAfter (AB, E, D, 10, ab);
+                        EXPECT_TRUE (single.cancel (ab));
+                        EXPECT_FALSE (single.cancel (d));
+                        EXPECT_EQ (single.getQueueMetrics ().nbQueuedJobs, 0);
+
+                        // Also when the dependent reads two producers with other blockings than its own
+                        SquareMatrix<double> EF (MATRIXSIZE);
+                        ab = single.startMultiply (A, B, AB, 10);
+                        int ef = single.startMultiply (E, F, EF, 10);
+                        d = single.startMultiplyAfter (AB, EF, D, 5, ab, ef);
+                        EXPECT_TRUE (single.cancel (ef));
+                        EXPECT_FALSE (single.cancel (d));
+                        single.wait (ab);
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+///
+/// Coroutine starting right away and destroyed once over, enough to drive the awaitables
+///
+struct DetachedCoroutine
+{
+  struct promise_type
+  {
+    DetachedCoroutine get_return_object () { return {}; }
+    std::suspend_never initial_suspend () noexcept { return {}; }
+    std::suspend_never final_suspend () noexcept { return {}; }
+    void return_void () {}
+    void unhandled_exception () { std::terminate (); }
+  };
+};
+
+///
+/// Executor resuming the coroutines when the test thread drains it
+///
+class QueueExecutor : public CoroutineExecutor
+{
+public:
+  void
+  post (std::coroutine_handle<> handle) override
+  {
+    mutex.lock ();
+    handles.push_back (handle);
+    mutex.unlock ();
+  }
+
+  void
+  runPending ()
+  {
+    mutex.lock ();
+    std::vector<std::coroutine_handle<>> ready;
+    ready.swap (handles);
+    mutex.unlock ();
+    for (auto handle : ready) {
+        handle.resume ();
+    }
+  }
+
+private:
+  PcoMutex mutex;
+  std::vector<std::coroutine_handle<>> handles;
+};
+
+DetachedCoroutine
+awaitProduct (ThreadedMultiplierType &multiplier, const SquareMatrix<float> &A, const SquareMatrix<float> &B,
+              SquareMatrix<float> &C, CoroutineExecutor *executor, std::thread::id &resumedOn,
+              std::atomic<int> &nbDone)
+{
+  bool completed = co_await multiplyAsync (multiplier, A, B, C, 4, executor);
+  resumedOn = std::this_thread::get_id ();
+  if (completed) {
+      nbDone++;
+  }
+}
+
+DetachedCoroutine
+awaitAllProducts (std::vector<MultiplyAwaitable<float>> &products, int &nbResumed, std::atomic<int> &nbDone)
+{
+  bool completed = co_await whenAll (products);
+  nbResumed++;
+  if (completed) {
+      nbDone++;
+  }
+}
+
+DetachedCoroutine
+awaitThenMultiply (ThreadedMultiplierType &multiplier, const SquareMatrix<float> &A, const SquareMatrix<float> &B,
+                   SquareMatrix<float> &C1, SquareMatrix<float> &C2, std::atomic<int> &nbDone)
+{
+  co_await multiplyAsync (multiplier, A, B, C1, 4);
+  // Resumed by the only worker, which must compute this product itself rather than wait for it
+  multiplier.multiply (A, B, C2, 4);
+  nbDone++;
+}
+
+// Products awaited by coroutines, with no thread blocked while they run
+TEST (Multiplier, CoroutineMultiply)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 40;
+                        constexpr int NBPRODUCTS = 200;
+                        SquareMatrix<float> A (MATRIXSIZE), B (MATRIXSIZE), C_ref (MATRIXSIZE);
+                        prepareMatrices (A, B, C_ref);
+                        std::vector<SquareMatrix<float>> results (NBPRODUCTS, SquareMatrix<float> (MATRIXSIZE));
+                        std::vector<std::thread::id> resumedOn (NBPRODUCTS);
+                        ThreadedMultiplierType multiplier (2);
+
+                        // Resumed by the workers
+                        std::atomic<int> nbDone{ 0 };
+                        for (int i = 0; i < NBPRODUCTS; ++i) {
+                            awaitProduct (multiplier, A, B, results[i], nullptr, resumedOn[i], nbDone);
+                        }
+                        while (nbDone < NBPRODUCTS) {
+                            PcoThread::usleep (1000);
+                        }
+                        for (int i = 0; i < NBPRODUCTS; ++i) {
+                            EXPECT_TRUE (sameMatrices (results[i], C_ref));
+                            EXPECT_NE (resumedOn[i], std::this_thread::get_id ());
+                        }
+
+                        // Resumed by the test thread, through the executor
+                        QueueExecutor executor;
+                        nbDone = 0;
+                        for (int i = 0; i < NBPRODUCTS; ++i) {
+                            awaitProduct (multiplier, A, B, results[i], &executor, resumedOn[i], nbDone);
+                        }
+                        while (nbDone < NBPRODUCTS) {
+                            executor.runPending ();
+                            PcoThread::usleep (100);
+                        }
+                        for (int i = 0; i < NBPRODUCTS; ++i) {
+                            EXPECT_EQ (resumedOn[i], std::this_thread::get_id ());
+                        }
+
+                        // All the products at once, the coroutine is resumed once
+                        std::vector<SquareMatrix<float>> moreResults (NBPRODUCTS, SquareMatrix<float> (MATRIXSIZE));
+                        std::vector<MultiplyAwaitable<float>> products;
+                        for (int i = 0; i < NBPRODUCTS; ++i) {
+                            products.emplace_back (multiplier, A, B, moreResults[i], 4);
+                        }
+                        int nbResumed = 0;
+                        nbDone = 0;
+                        awaitAllProducts (products, nbResumed, nbDone);
+                        while (nbDone < 1) {
+                            PcoThread::usleep (1000);
+                        }
+                        EXPECT_EQ (nbResumed, 1);
+                        for (auto &C : moreResults) {
+                            EXPECT_TRUE (sameMatrices (C, C_ref));
+                        }
+
+                        // A coroutine resumed by a worker may run another product
+                        ThreadedMultiplierType single (1);
+                        SquareMatrix<float> C1 (MATRIXSIZE), C2 (MATRIXSIZE);
+                        nbDone = 0;
+                        awaitThenMultiply (single, A, B, C1, C2, nbDone);
+                        while (nbDone < 1) {
+                            PcoThread::usleep (1000);
+                        }
+                        EXPECT_TRUE (sameMatrices (C1, C_ref));
+                        EXPECT_TRUE (sameMatrices (C2, C_ref));
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+///
+/// Checks a backend gives exactly the result of the reference kernel on a product
+///
+template<class Multiplier>
+void checkBackend (const char *name, const SquareMatrix<float> &A, const SquareMatrix<float> &B,
+                   const SquareMatrix<float> &C_ref, int nbThreads, int nbBlocksPerRow)
+{
+  SquareMatrix<float> C (A.size ());
+  Multiplier multiplier (nbThreads, nbBlocksPerRow);
+  multiplier.multiply (A, B, C);
+  EXPECT_TRUE (sameMatrices (C, C_ref)) << name;
+}
+
+// The same blocks scheduled by our pool, by OpenMP and by the standard parallel algorithms
+TEST (Multiplier, StandardBackends)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 400;
+                        constexpr int NBTHREADS = 4;
+                        constexpr int NBBLOCKSPERROW = 8;
+                        SquareMatrix<float> A (MATRIXSIZE), B (MATRIXSIZE), C_ref (MATRIXSIZE);
+                        prepareMatrices (A, B, C_ref);
+
+                        checkBackend<ThreadedMatrixMultiplier<float>> ("Backend pcosynchro", A, B, C_ref,
+                                                                         NBTHREADS, NBBLOCKSPERROW);
+                        checkBackend<OpenMPMatrixMultiplier<float>> ("Backend OpenMP", A, B, C_ref,
+                                                                       NBTHREADS, NBBLOCKSPERROW);
+                        checkBackend<StdParMatrixMultiplier<float>> ("Backend std::execution", A, B, C_ref,
+                                                                       NBTHREADS, NBBLOCKSPERROW);
+
+                        MultiplierTester<OpenMPMatrixMultiplier<float>> openMPTester;
+                        openMPTester.test (500, NBTHREADS, 5);
+                        MultiplierTester<StdParMatrixMultiplier<float>> stdParTester;
+                        stdParTester.test (500, NBTHREADS, 5);
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+// Products of any size routed to the backend calibrated as the fastest
+TEST (Multiplier, AutoDispatch)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        AutoMatrixMultiplier<float> multiplier (4);
+                        multiplier.registerBackend ("openmp", [] (const SquareMatrix<float> &A,
+                                                                  const SquareMatrix<float> &B, SquareMatrix<float> &C) {
+                            OpenMPMatrixMultiplier<float> openMP (4, 1);
+                            openMP.multiply (A, B, C);
+                        });
+                        multiplier.calibrate (128);
+                        EXPECT_EQ (multiplier.chooseBackend (8), "inline");
+
+                        for (int size : { 7, 30, 64, 150, 300 }) {
+                            SquareMatrix<float> A (size), B (size), C (size), C_ref (size);
+                            prepareMatrices (A, B, C_ref);
+                            multiplier.multiply (A, B, C);
+                            EXPECT_TRUE (sameMatrices (C, C_ref)) << size;
+                            const std::string &backend = multiplier.chooseBackend (size);
+                            EXPECT_TRUE (backend == "inline" || backend == "threaded" || backend == "openmp") << backend;
+                        }
+
+                        // Concurrent first calls share a single lazy calibration
+                        AutoMatrixMultiplier<float> fresh (4);
+                        SquareMatrix<float> A (64), B (64), C_ref (64);
+                        prepareMatrices (A, B, C_ref);
+                        std::atomic<int> nbErrors{ 0 };
+                        std::vector<std::unique_ptr<PcoThread>> callers;
+                        for (int i = 0; i < 4; i++) {
+                            callers.push_back (std::make_unique<PcoThread> ([&] () {
+                                SquareMatrix<float> C (64);
+                                fresh.multiply (A, B, C);
+                                if (!sameMatrices (C, C_ref)) {
+                                    nbErrors++;
+                                }
+                            }));
+                        }
+                        for (auto &caller : callers) {
+                            caller->join ();
+                        }
+                        EXPECT_EQ (nbErrors.load (), 0);
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+///
+/// Reference column-major gemm, the loops of the reference BLAS without the blocking
+///
+template<class T>
+void referenceGemm (bool transA, bool transB, int m, int n, int k, T alpha, const std::vector<T> &a, int lda,
+                    const std::vector<T> &b, int ldb, T beta, std::vector<T> &c, int ldc)
+{
+  for (int j = 0; j < n; j++) {
+      for (int i = 0; i < m; i++) {
+          T sum = 0;
+          for (int l = 0; l < k; l++) {
+              T x = transA ? a[l + i * lda] : a[i + l * lda];
+              T y = transB ? b[j + l * ldb] : b[l + j * ldb];
+              sum += x * y;
+          }
+          c[i + j * ldc] = alpha * sum + beta * c[i + j * ldc];
+      }
+  }
+}
+
+// The BLAS entry points, on rectangular matrices with padded leading dimensions
+TEST (Multiplier, BlasGemm)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int M = 70, N = 90, K = 50;
+                        for (char transa : { 'N', 'T' }) {
+                            for (char transb : { 'N', 'T' }) {
+                                bool transA = transa == 'T';
+                                bool transB = transb == 'T';
+                                int lda = (transA ? K : M) + 3;
+                                int ldb = (transB ? N : K) + 1;
+                                int ldc = M + 2;
+                                std::vector<double> a (lda * (transA ? M : K)), b (ldb * (transB ? K : N));
+                                std::vector<double> c (ldc * N), c_ref;
+                                for (auto &x : a) x = rand () % 100 - 50;
+                                for (auto &x : b) x = rand () % 100 - 50;
+                                for (auto &x : c) x = rand () % 100 - 50;
+                                c_ref = c;
+
+                                int m = M, n = N, k = K;
+                                double alpha = 2, beta = -1;
+                                dgemm_ (&transa, &transb, &m, &n, &k, &alpha, a.data (), &lda, b.data (), &ldb, &beta,
+                                        c.data (), &ldc);
+                                referenceGemm (transA, transB, M, N, K, alpha, a, lda, b, ldb, beta, c_ref, ldc);
+                                EXPECT_EQ (c, c_ref) << transa << transb;
+                            }
+                        }
+
+                        // Row-major CBLAS, C is not read with beta = 0
+                        std::vector<float> a (M * K), b (K * N), c (M * N, std::numeric_limits<float>::quiet_NaN ());
+                        for (auto &x : a) x = rand () % 10;
+                        for (auto &x : b) x = rand () % 10;
+                        cblas_sgemm (CblasRowMajor, CblasNoTrans, CblasNoTrans, M, N, K, 1.0f, a.data (), K, b.data (), N,
+                                     0.0f, c.data (), N);
+                        // Row-major C = A * B is the column-major C^T = B^T * A^T
+                        std::vector<float> c_ref (M * N, 0.0f);
+                        referenceGemm (false, false, N, M, K, 1.0f, b, N, a, K, 0.0f, c_ref, N);
+                        EXPECT_EQ (c, c_ref);
+
+                        // A and B are not read with alpha = 0, whether transposed or not
+                        a[3] = std::numeric_limits<float>::quiet_NaN ();
+                        b[5] = std::numeric_limits<float>::infinity ();
+                        for (char transa : { 'N', 'T' }) {
+                            std::vector<float> scaled (c);
+                            int m = M, n = N, k = K, lda = transa == 'N' ? M : K, ldb = K, ldc = M;
+                            float alpha = 0, beta = 2;
+                            char transb = 'N';
+                            sgemm_ (&transa, &transb, &m, &n, &k, &alpha, a.data (), &lda, b.data (), &ldb, &beta,
+                                    scaled.data (), &ldc);
+                            for (int i = 0; i < M * N; i++) {
+                                EXPECT_EQ (scaled[i], 2 * c[i]) << transa;
+                            }
+                        }
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+// Sums of scaled products and matrices, evaluated in one pass
+TEST (Multiplier, ExpressionTemplates)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 150;
+                        SquareMatrix<float> A (MATRIXSIZE), B (MATRIXSIZE), D (MATRIXSIZE), E (MATRIXSIZE);
+                        SquareMatrix<float> C (MATRIXSIZE), AB (MATRIXSIZE), DE (MATRIXSIZE), C_ref (MATRIXSIZE);
+                        // Small integers, so that the sums are exact whatever their order
+                        for (int i = 0; i < MATRIXSIZE; i++) {
+                            for (int j = 0; j < MATRIXSIZE; j++) {
+                                A.setElement (i, j, rand () % 10);
+                                B.setElement (i, j, rand () % 10);
+                                D.setElement (i, j, rand () % 10);
+                                E.setElement (i, j, rand () % 10);
+                            }
+                        }
+                        SimpleMatrixMultiplier<float> simple;
+                        simple.multiply (A, B, AB);
+                        simple.multiply (D, E, DE);
+
+                        C = A * B + 2.0f * (D * E) - D;
+                        for (int i = 0; i < MATRIXSIZE; i++) {
+                            for (int j = 0; j < MATRIXSIZE; j++) {
+                                C_ref.setElement (i, j, AB.element (i, j) + 2 * DE.element (i, j) - D.element (i, j));
+                            }
+                        }
+                        EXPECT_TRUE (sameMatrices (C, C_ref));
+
+                        // C as a term is read in place, as an operand of a product through a temporary
+                        C = A * B;
+                        C = C + D * E;
+                        for (int i = 0; i < MATRIXSIZE; i++) {
+                            for (int j = 0; j < MATRIXSIZE; j++) {
+                                EXPECT_EQ (C.element (i, j), AB.element (i, j) + DE.element (i, j));
+                            }
+                        }
+                        C = A * B;
+                        C = C * E;
+                        simple.multiply (AB, E, C_ref);
+                        EXPECT_TRUE (sameMatrices (C, C_ref));
+
+                        // No temporary is allocated once the multiplier is warmed up
+                        ThreadedMultiplierType multiplier (4);
+                        evaluate (multiplier, C, A * B + D);
+                        long long before = nbAllocations.load ();
+                        for (int i = 0; i < 10; i++) {
+                            evaluate (multiplier, C, A * B + D);
+                        }
+                        EXPECT_EQ (nbAllocations.load () - before, 0);
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+// Several products added to the same result
+TEST (Multiplier, MultiplyAccumulate)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 120;
+                        constexpr int NBPRODUCTS = 4;
+                        SquareMatrix<float> A (MATRIXSIZE), B (MATRIXSIZE), AB (MATRIXSIZE);
+                        SquareMatrix<float> C (MATRIXSIZE), C_expr (MATRIXSIZE), C_ref (MATRIXSIZE);
+                        // Small integers, so that the sums are exact whatever their order
+                        for (int i = 0; i < MATRIXSIZE; i++) {
+                            for (int j = 0; j < MATRIXSIZE; j++) {
+                                A.setElement (i, j, rand () % 10);
+                                B.setElement (i, j, rand () % 10);
+                                C.setElement (i, j, rand () % 10);
+                            }
+                        }
+                        C_expr = C;
+                        SimpleMatrixMultiplier<float> simple;
+                        simple.multiply (A, B, AB);
+                        for (int i = 0; i < MATRIXSIZE; i++) {
+                            for (int j = 0; j < MATRIXSIZE; j++) {
+                                C_ref.setElement (i, j, C.element (i, j) + NBPRODUCTS * AB.element (i, j));
+                            }
+                        }
+
+                        ThreadedMultiplierType multiplier (4);
+                        multiplier.multiplyAccumulate (A, B, C, 4);
+                        long long before = nbAllocations.load ();
+                        for (int i = 1; i < NBPRODUCTS; i++) {
+                            multiplier.multiplyAccumulate (A, B, C, 4);
+                        }
+                        EXPECT_EQ (nbAllocations.load () - before, 0);
+                        EXPECT_TRUE (sameMatrices (C, C_ref));
+
+                        for (int i = 0; i < NBPRODUCTS; i++) {
+                            C_expr += A * B;
+                        }
+                        EXPECT_TRUE (sameMatrices (C_expr, C_ref));
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+///
+/// Checks the blocks handed over by a streaming product, which must already hold their final values
+///
+struct TileChecker
+{
+  const SquareMatrix<float> *C;
+  const SquareMatrix<float> *C_ref;
+  int blockSize;
+  std::atomic<int> nbTiles{ 0 };
+  std::atomic<int> nbWrongTiles{ 0 };
+  std::vector<int> order; // Row-major indices of the blocks, when delivered by one thread at a time
+
+  TileChecker (const SquareMatrix<float> &C, const SquareMatrix<float> &C_ref, int blockSize)
+      : C (&C), C_ref (&C_ref), blockSize (blockSize)
+  {
+  }
+
+  static void
+  tileDone (void *context, int blockI, int blockJ)
+  {
+    auto *checker = static_cast<TileChecker *> (context);
+    checker->check (blockI, blockJ);
+  }
+
+  static void
+  orderedTileDone (void *context, int blockI, int blockJ)
+  {
+    auto *checker = static_cast<TileChecker *> (context);
+    checker->order.push_back (blockI * (checker->C->size () / checker->blockSize) + blockJ);
+    checker->check (blockI, blockJ);
+  }
+
+  void
+  check (int blockI, int blockJ)
+  {
+    nbTiles++;
+    for (int i = blockI * blockSize; i < (blockI + 1) * blockSize; i++) {
+        for (int j = blockJ * blockSize; j < (blockJ + 1) * blockSize; j++) {
+            if (C->element (j, i) != C_ref->element (j, i)) {
+                nbWrongTiles++;
+                return;
+            }
+        }
+    }
+  }
+};
+
+// Blocks handed over to a callback or a queue as they are computed, in completion or row panel order
+TEST (Multiplier, StreamingTiles)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 200;
+                        constexpr int NBBLOCKSPERROW = 5;
+                        constexpr int NBTILES = NBBLOCKSPERROW * NBBLOCKSPERROW;
+                        SquareMatrix<float> A (MATRIXSIZE), B (MATRIXSIZE), C (MATRIXSIZE), C_ref (MATRIXSIZE);
+                        prepareMatrices (A, B, C_ref);
+                        ThreadedMultiplierType multiplier (4);
+
+                        TileChecker checker (C, C_ref, MATRIXSIZE / NBBLOCKSPERROW);
+                        multiplier.multiply (A, B, C, NBBLOCKSPERROW, TileCallback{ &TileChecker::tileDone, &checker });
+                        EXPECT_EQ (checker.nbTiles, NBTILES);
+                        EXPECT_EQ (checker.nbWrongTiles, 0);
+
+                        SquareMatrix<float> C2 (MATRIXSIZE);
+                        TileChecker orderedChecker (C2, C_ref, MATRIXSIZE / NBBLOCKSPERROW);
+                        multiplyStreaming (multiplier, A, B, C2, NBBLOCKSPERROW,
+                                           TileCallback{ &TileChecker::orderedTileDone, &orderedChecker },
+                                           TileOrder::RowPanelsInOrder);
+                        EXPECT_EQ (orderedChecker.nbWrongTiles, 0);
+                        ASSERT_EQ (orderedChecker.order.size (), NBTILES);
+                        for (int i = 0; i < NBTILES; i++) {
+                            EXPECT_EQ (orderedChecker.order[i], i);
+                        }
+
+                        // The calling thread consumes the blocks while the workers compute the next ones
+                        for (TileOrder order : { TileOrder::AsCompleted, TileOrder::RowPanelsInOrder }) {
+                            SquareMatrix<float> C3 (MATRIXSIZE);
+                            TileChecker streamChecker (C3, C_ref, MATRIXSIZE / NBBLOCKSPERROW);
+                            TileStream stream;
+                            stream.start (multiplier, A, B, C3, NBBLOCKSPERROW, order);
+                            int blockI, blockJ;
+                            while (stream.pop (blockI, blockJ)) {
+                                if (order == TileOrder::RowPanelsInOrder) {
+                                    TileChecker::orderedTileDone (&streamChecker, blockI, blockJ);
+                                }
+                                else {
+                                    TileChecker::tileDone (&streamChecker, blockI, blockJ);
+                                }
+                            }
+                            EXPECT_TRUE (stream.isComplete ());
+                            EXPECT_EQ (streamChecker.nbTiles, NBTILES);
+                            EXPECT_EQ (streamChecker.nbWrongTiles, 0);
+                            for (int i = 0; i < static_cast<int> (streamChecker.order.size ()); i++) {
+                                EXPECT_EQ (streamChecker.order[i], i);
+                            }
+                        }
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+// A few rows of A and a column of B modified between two products
+TEST (Multiplier, IncrementalMultiply)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 200;
+                        constexpr int NBBLOCKSPERROW = 5;
+                        constexpr int RANK = 3;
+                        SquareMatrix<float> A (MATRIXSIZE), B (MATRIXSIZE), C (MATRIXSIZE), C_ref (MATRIXSIZE);
+                        prepareMatrices (A, B, C_ref);
+                        ThreadedMultiplierType multiplier (4);
+                        multiplier.multiply (A, B, C, NBBLOCKSPERROW);
+
+                        // Rows 3 and 100 of A are in the row panels 0 and 2, column 50 of B in the column panel 1
+                        for (int x = 0; x < MATRIXSIZE; x++) {
+                            A.updateElement (x, 3, rand ());
+                            A.updateElement (x, 100, rand ());
+                        }
+                        for (int y = 0; y < MATRIXSIZE; y++) {
+                            B.updateElement (50, y, rand ());
+                        }
+                        EXPECT_EQ (multiplier.multiplyIncremental (A, B, C, NBBLOCKSPERROW), 2 * 5 + 5 - 2);
+                        SimpleMatrixMultiplier<float> simple;
+                        simple.multiply (A, B, C_ref);
+                        EXPECT_TRUE (sameMatrices (C, C_ref));
+                        EXPECT_EQ (multiplier.multiplyIncremental (A, B, C, NBBLOCKSPERROW), 0);
+
+                        // A single operand, whose element (row 120, column 7) feeds row 120 and column 7 of C
+                        multiplier.multiply (A, A, C, NBBLOCKSPERROW);
+                        A.updateElement (7, 120, rand ());
+                        EXPECT_EQ (multiplier.multiplyIncremental (A, A, C, NBBLOCKSPERROW), 5 + 5 - 1);
+                        simple.multiply (A, A, C_ref);
+                        EXPECT_TRUE (sameMatrices (C, C_ref));
+                        // Modified rows of the right operand feed all the columns of C
+                        for (int x = 0; x < MATRIXSIZE; x++) {
+                            A.setElement (x, 30, rand ());
+                        }
+                        A.markRowsDirty (30, 31);
+                        EXPECT_EQ (multiplier.multiplyIncremental (A, A, C, NBBLOCKSPERROW), 25);
+                        simple.multiply (A, A, C_ref);
+                        EXPECT_TRUE (sameMatrices (C, C_ref));
+
+                        // C += U * V^T, with small integers so that the sums are exact
+                        Matrix<float> U (RANK, MATRIXSIZE), V (RANK, MATRIXSIZE);
+                        for (int y = 0; y < MATRIXSIZE; y++) {
+                            for (int l = 0; l < RANK; l++) {
+                                U.setElement (l, y, rand () % 10);
+                                V.setElement (l, y, rand () % 10);
+                            }
+                        }
+                        SquareMatrix<float> D (MATRIXSIZE), D_ref (MATRIXSIZE);
+                        for (int i = 0; i < MATRIXSIZE; i++) {
+                            for (int j = 0; j < MATRIXSIZE; j++) {
+                                D.setElement (j, i, rand () % 10);
+                                float sum = D.element (j, i);
+                                for (int l = 0; l < RANK; l++) {
+                                    sum += U.element (l, i) * V.element (l, j);
+                                }
+                                D_ref.setElement (j, i, sum);
+                            }
+                        }
+                        multiplier.rankUpdate (U, V, D, NBBLOCKSPERROW);
+                        EXPECT_TRUE (sameMatrices (D, D_ref));
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+// Repeated products copied from the cache, concurrent identical ones computed once
+TEST (Multiplier, CachedMultiply)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 100;
+                        constexpr int NBCALLERS = 4;
+                        constexpr long long RESULTBYTES = sizeof (float) * MATRIXSIZE * MATRIXSIZE;
+                        SquareMatrix<float> A (MATRIXSIZE), B (MATRIXSIZE), C (MATRIXSIZE), C_ref (MATRIXSIZE);
+                        SquareMatrix<float> D (MATRIXSIZE), E (MATRIXSIZE), DE_ref (MATRIXSIZE);
+                        prepareMatrices (A, B, C_ref);
+                        prepareMatrices (D, E, DE_ref);
+                        ThreadedMultiplierType multiplier (4);
+                        CachingMatrixMultiplier<float> cache (multiplier, 4, 2 * RESULTBYTES);
+
+                        cache.multiply (A, B, C);
+                        EXPECT_TRUE (sameMatrices (C, C_ref));
+                        SquareMatrix<float> C2 (MATRIXSIZE);
+                        cache.multiply (A, B, C2);
+                        EXPECT_TRUE (sameMatrices (C2, C_ref));
+                        EXPECT_EQ (cache.getStats ().nbHits, 1);
+                        EXPECT_EQ (cache.getStats ().nbMisses, 1);
+
+                        // A modified operand is a new product
+                        A.setElement (0, 0, A.element (0, 0) * 2);
+                        cache.multiply (A, B, C);
+                        EXPECT_EQ (cache.getStats ().nbMisses, 2);
+
+                        // The third result exceeds the budget, the least recently used one is dropped
+                        SquareMatrix<float> DE (MATRIXSIZE);
+                        cache.multiply (D, E, DE);
+                        EXPECT_TRUE (sameMatrices (DE, DE_ref));
+                        EXPECT_EQ (cache.getStats ().nbEvictions, 1);
+                        EXPECT_EQ (cache.getStats ().nbBytes, 2 * RESULTBYTES);
+
+                        // Version tags supplied by the caller
+                        cache.multiply (D, 7, E, 1, DE);
+                        cache.multiply (D, 7, E, 1, DE);
+                        EXPECT_TRUE (sameMatrices (DE, DE_ref));
+                        EXPECT_EQ (cache.getStats ().nbMisses, 4);
+
+                        // Concurrent callers of the same product share a single computation
+                        cache.clear ();
+                        CacheStats before = cache.getStats ();
+                        std::vector<SquareMatrix<float>> results (NBCALLERS, SquareMatrix<float> (MATRIXSIZE));
+                        std::vector<std::unique_ptr<PcoThread>> callers;
+                        for (int i = 0; i < NBCALLERS; i++) {
+                            callers.push_back (std::make_unique<PcoThread> (
+                                [&, i] () { cache.multiply (D, E, results[i]); }));
+                        }
+                        for (auto &caller : callers) {
+                            caller->join ();
+                        }
+                        CacheStats after = cache.getStats ();
+                        EXPECT_EQ (after.nbMisses - before.nbMisses, 1);
+                        EXPECT_EQ (after.nbHits + after.nbSharedInFlight - before.nbHits - before.nbSharedInFlight,
+                                   NBCALLERS - 1);
+                        for (auto &result : results) {
+                            EXPECT_TRUE (sameMatrices (result, DE_ref));
+                        }
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+///
+/// Returns |M1 - M2| / |M2|, Frobenius norms
+///
+template<class T>
+double relativeError (const SquareMatrix<T> &M1, const SquareMatrix<T> &M2)
+{
+  double difference = 0, norm = 0;
+  for (int x = 0; x < M1.size (); x++) {
+      for (int y = 0; y < M1.size (); y++) {
+          double d = M1.element (x, y) - M2.element (x, y);
+          difference += d * d;
+          norm += static_cast<double> (M2.element (x, y)) * M2.element (x, y);
+      }
+  }
+  return std::sqrt (difference / norm);
+}
+
+// Sampled products within the error asked for
+TEST (Multiplier, ApproximateMultiply)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 300;
+                        SquareMatrix<double> A (MATRIXSIZE), B (MATRIXSIZE), C (MATRIXSIZE), C_ref (MATRIXSIZE);
+                        // Non-negative elements, as the similarities of a search, and a few dominant columns of A
+                        for (int i = 0; i < MATRIXSIZE; i++) {
+                            for (int j = 0; j < MATRIXSIZE; j++) {
+                                A.setElement (j, i, (rand () % 100) * (j % 10 == 0 ? 10 : 1));
+                                B.setElement (j, i, rand () % 100);
+                            }
+                        }
+                        SimpleMatrixMultiplier<double> simple;
+                        simple.multiply (A, B, C_ref);
+                        ThreadedMatrixMultiplier<double> multiplier (4);
+
+                        for (double target : { 0.3, 0.2 }) {
+                            ApproximationReport report = multiplyApproximate (multiplier, A, B, C, target, 42);
+                            double error = relativeError (C, C_ref);
+                            EXPECT_FALSE (report.isExact);
+                            EXPECT_LT (report.nbSamples, MATRIXSIZE / 4);
+                            EXPECT_LE (report.expectedRelativeError, target * 1.1);
+                            EXPECT_LT (error, 2 * target);
+                        }
+
+                        ApproximationReport report = multiplyApproximate (multiplier, A, B, C, 0.0);
+                        EXPECT_TRUE (report.isExact);
+                        EXPECT_TRUE (sameMatrices (C, C_ref));
+
+                        // The same samples on integers only round the estimate, not the weights
+                        SquareMatrix<int> intA (MATRIXSIZE), intB (MATRIXSIZE), intC (MATRIXSIZE);
+                        for (int i = 0; i < MATRIXSIZE; i++) {
+                            for (int j = 0; j < MATRIXSIZE; j++) {
+                                intA.setElement (j, i, static_cast<int> (A.element (j, i)));
+                                intB.setElement (j, i, static_cast<int> (B.element (j, i)));
+                            }
+                        }
+                        ThreadedMatrixMultiplier<int> intMultiplier (4);
+                        report = multiplyApproximate (intMultiplier, intA, intB, intC, 0.3, 42);
+                        EXPECT_FALSE (report.isExact);
+                        multiplyApproximate (multiplier, A, B, C, 0.3, 42);
+                        for (int i = 0; i < MATRIXSIZE; i++) {
+                            for (int j = 0; j < MATRIXSIZE; j++) {
+                                EXPECT_EQ (intC.element (j, i), std::llround (C.element (j, i))) << i << " " << j;
+                            }
+                        }
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+// The largest elements of each row of a product, C not being stored
+TEST (Multiplier, TopKPerRow)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 200;
+                        constexpr int K = 5;
+                        SquareMatrix<float> A (MATRIXSIZE), B (MATRIXSIZE), C_ref (MATRIXSIZE);
+                        prepareMatrices (A, B, C_ref);
+                        ThreadedMultiplierType multiplier (4);
+
+                        TopKResult<float> result = multiplyTopK (multiplier, A, B, K);
+                        for (int i = 0; i < MATRIXSIZE; i++) {
+                            std::vector<TopKEntry<float>> expected;
+                            for (int j = 0; j < MATRIXSIZE; j++) {
+                                expected.push_back ({ j, C_ref.element (j, i) });
+                            }
+                            std::sort (expected.begin (), expected.end (), isBetterEntry<float>);
+                            ASSERT_EQ (result.rowSize (i), K);
+                            for (int e = 0; e < K; e++) {
+                                EXPECT_EQ (result.row (i)[e].index, expected[e].index) << i << " " << e;
+                                EXPECT_EQ (result.row (i)[e].value, expected[e].value) << i << " " << e;
+                            }
+                        }
+
+                        // Rows shorter than k are kept whole
+                        SquareMatrix<float> A2 (3), B2 (3), C2_ref (3);
+                        prepareMatrices (A2, B2, C2_ref);
+                        TopKResult<float> small = multiplyTopK (multiplier, A2, B2, K);
+                        EXPECT_EQ (small.rowSize (0), 3);
+
+                        // The NaNs of column 2 of C rank last
+                        B2.setElement (2, 1, std::numeric_limits<float>::quiet_NaN ());
+                        small = multiplyTopK (multiplier, A2, B2, 3);
+                        for (int i = 0; i < 3; i++) {
+                            EXPECT_EQ (small.row (i)[2].index, 2);
+                            EXPECT_TRUE (std::isnan (small.row (i)[2].value));
+                        }
+                        small = multiplyTopK (multiplier, A2, B2, 2);
+                        for (int i = 0; i < 3; i++) {
+                            EXPECT_NE (small.row (i)[0].index, 2);
+                            EXPECT_NE (small.row (i)[1].index, 2);
+                        }
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+// Only the elements of a sparse pattern, with rows of very different lengths
+TEST (Multiplier, MaskedMultiply)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 150;
+                        SquareMatrix<float> A (MATRIXSIZE), B (MATRIXSIZE), C_ref (MATRIXSIZE);
+                        // Small integers, so that the sums are exact whatever their order
+                        for (int i = 0; i < MATRIXSIZE; i++) {
+                            for (int j = 0; j < MATRIXSIZE; j++) {
+                                A.setElement (i, j, rand () % 10);
+                                B.setElement (i, j, rand () % 10);
+                            }
+                        }
+                        SimpleMatrixMultiplier<float> simple;
+                        simple.multiply (A, B, C_ref);
+
+                        // About 5% of the elements, row 7 empty and row 20 full
+                        SparsePattern mask;
+                        mask.rowOffsets.push_back (0);
+                        for (int i = 0; i < MATRIXSIZE; i++) {
+                            for (int j = 0; j < MATRIXSIZE; j++) {
+                                if (i != 7 && (i == 20 || rand () % 20 == 0)) {
+                                    mask.columns.push_back (j);
+                                }
+                            }
+                            mask.rowOffsets.push_back (mask.getNbElements ());
+                        }
+
+                        ThreadedMultiplierType multiplier (4);
+                        std::vector<float> values = multiplyMasked (multiplier, A, B, mask);
+                        ASSERT_EQ (static_cast<int> (values.size ()), mask.getNbElements ());
+                        for (int i = 0; i < MATRIXSIZE; i++) {
+                            for (int e = mask.rowOffsets[i]; e < mask.rowOffsets[i + 1]; e++) {
+                                EXPECT_EQ (values[e], C_ref.element (mask.columns[e], i)) << i;
+                            }
+                        }
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+///
+/// Corrupts an element of the blocks (1, 2) and (3, 3) on their first computation, and of the block (4, 0)
+/// on every computation
+///
+void
+injectFaults (void *, SquareMatrix<float> &C, int blockI, int blockJ, int attempt)
+{
+  bool transient = attempt == 0 && ((blockI == 1 && blockJ == 2) || (blockI == 3 && blockJ == 3));
+  bool permanent = blockI == 4 && blockJ == 0;
+  if (transient || permanent) {
+      int x = blockJ * 40 + 7, y = blockI * 40 + 11;
+      C.setElement (x, y, C.element (x, y) * 2 + 1000);
+  }
+}
+
+// Blocks checked against checksums of the operands, the corrupted ones being recomputed
+TEST (Multiplier, VerifiedMultiply)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 200;
+                        constexpr int NBBLOCKSPERROW = 5;
+                        SquareMatrix<float> A (MATRIXSIZE), B (MATRIXSIZE), C (MATRIXSIZE), C_ref (MATRIXSIZE);
+                        ThreadedMultiplierType multiplier (4);
+
+                        // No false alarm with the rounding errors of large values
+                        prepareMatrices (A, B, C_ref);
+                        VerificationReport report = multiplyVerified (multiplier, A, B, C, NBBLOCKSPERROW);
+                        EXPECT_EQ (report.nbCorruptedTiles, 0);
+                        EXPECT_EQ (report.nbRetries, 0);
+                        EXPECT_TRUE (sameMatrices (C, C_ref));
+
+                        for (int i = 0; i < MATRIXSIZE; i++) {
+                            for (int j = 0; j < MATRIXSIZE; j++) {
+                                A.setElement (i, j, rand () % 10);
+                                B.setElement (i, j, rand () % 10);
+                            }
+                        }
+                        SimpleMatrixMultiplier<float> simple;
+                        simple.multiply (A, B, C_ref);
+                        report = multiplyVerified (multiplier, A, B, C, NBBLOCKSPERROW, 2,
+                                                   FaultInjector<float>{ &injectFaults, nullptr });
+                        EXPECT_EQ (report.nbCorruptedTiles, 3);
+                        EXPECT_EQ (report.nbRetries, 1 + 1 + 2);
+                        EXPECT_EQ (report.nbUnrecoveredTiles, 1);
+                        // Only the block with a permanent fault is wrong
+                        EXPECT_NE (C.element (7, 4 * 40 + 11), C_ref.element (7, 4 * 40 + 11));
+                        C.setElement (7, 4 * 40 + 11, C_ref.element (7, 4 * 40 + 11));
+                        EXPECT_TRUE (sameMatrices (C, C_ref));
+
+                        // Integer products that overflow are checked modulo 2^32, not reported as corrupted
+                        SquareMatrix<unsigned> U (MATRIXSIZE), V (MATRIXSIZE), W (MATRIXSIZE), W_ref (MATRIXSIZE);
+                        for (int i = 0; i < MATRIXSIZE; i++) {
+                            for (int j = 0; j < MATRIXSIZE; j++) {
+                                U.setElement (i, j, rand ());
+                                V.setElement (i, j, rand ());
+                            }
+                        }
+                        SimpleMatrixMultiplier<unsigned> simpleUnsigned;
+                        simpleUnsigned.multiply (U, V, W_ref);
+                        ThreadedMatrixMultiplier<unsigned> unsignedMultiplier (4);
+                        report = multiplyVerified (unsignedMultiplier, U, V, W, NBBLOCKSPERROW);
+                        EXPECT_EQ (report.nbCorruptedTiles, 0);
+                        EXPECT_TRUE (sameMatrices (W, W_ref));
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+// Deterministic mode: the same bits whatever the threads and the blocks
+TEST (Multiplier, DeterministicMode)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 400;
+                        SquareMatrix<float> A (MATRIXSIZE), B (MATRIXSIZE), C_ref (MATRIXSIZE), C (MATRIXSIZE);
+                        prepareMatrices (A, B, C_ref);
+
+                        {
+                            ThreadedMultiplierType multiplier (1);
+                            multiplier.setDeterministic (true);
+                            multiplier.multiply (A, B, C_ref, 1);
+                        }
+                        for (int nbThreads : { 1, 3, 4 }) {
+                            ThreadedMultiplierType multiplier (nbThreads);
+                            multiplier.setDeterministic (true);
+                            for (int nbBlocksPerRow : { 1, 2, 4, 5 }) {
+                                multiplier.multiply (A, B, C, nbBlocksPerRow);
+                                EXPECT_TRUE (sameMatrices (C, C_ref))
+                                    << nbThreads << " threads, " << nbBlocksPerRow << " blocks per row";
+                            }
+                        }
+
+                        // Switching the mode on a live multiplier takes effect on the next product
+                        ThreadedMultiplierType multiplier (4);
+                        for (bool deterministic : { false, true, false, true }) {
+                            multiplier.setDeterministic (deterministic);
+                            multiplier.multiply (A, B, C, 4);
+                            if (deterministic) {
+                                EXPECT_TRUE (sameMatrices (C, C_ref));
+                            }
+                            else {
+                                EXPECT_LT (relativeError (C, C_ref), 1e-5);
+                            }
+                        }
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
+// Checkpoint and resume: a resumed product only computes the blocks missing from the file
+TEST (Multiplier, CheckpointResume)
+{
+
+#ifdef CHECK_DURATION
+  ASSERT_DURATION_LE (30, ({
+#endif // CHECK_DURATION
+                        constexpr int MATRIXSIZE = 200;
+                        constexpr int NBBLOCKSPERROW = 5;
+                        const std::string path = testing::TempDir () + "pco_checkpoint";
+                        SquareMatrix<float> A (MATRIXSIZE), B (MATRIXSIZE), C_ref (MATRIXSIZE);
+                        prepareMatrices (A, B, C_ref);
+                        ThreadedMultiplierType multiplier (4);
+
+                        // The thread of the checkpoint syncs the copied blocks by itself
+                        {
+                            TileCheckpoint<float> checkpoint;
+                            ASSERT_TRUE (checkpoint.open (path, A, B, NBBLOCKSPERROW, std::chrono::milliseconds (0), false));
+                            checkpoint.tileComputed (C_ref, 1, 1);
+                            for (int i = 0; i < 1000 && !checkpoint.isTileDone (1, 1); i++) {
+                                PcoThread::usleep (1000);
+                            }
+                            EXPECT_EQ (checkpoint.missingTiles ().size (), 24u);
+                        }
+
+                        // A process saving 7 blocks before dying
+                        {
+                            TileCheckpoint<float> checkpoint;
+                            ASSERT_TRUE (checkpoint.open (path, A, B, NBBLOCKSPERROW, std::chrono::hours (1), false));
+                            for (int tile = 0; tile < 7; tile++) {
+                                checkpoint.tileComputed (C_ref, tile / NBBLOCKSPERROW, (tile * 3) % NBBLOCKSPERROW);
+                            }
+                            // Not synced yet
+                            EXPECT_EQ (checkpoint.missingTiles ().size (), 25u);
+                            checkpoint.sync ();
+                            EXPECT_EQ (checkpoint.missingTiles ().size (), 18u);
+                        }
+
+                        SquareMatrix<float> C (MATRIXSIZE);
+                        EXPECT_EQ (resumeCheckpointed (multiplier, A, B, C, NBBLOCKSPERROW, path, std::chrono::milliseconds (0)), 18);
+                        EXPECT_TRUE (sameMatrices (C, C_ref));
+                        // All the blocks are now saved
+                        SquareMatrix<float> C2 (MATRIXSIZE);
+                        EXPECT_EQ (resumeCheckpointed (multiplier, A, B, C2, NBBLOCKSPERROW, path, std::chrono::milliseconds (0)), 0);
+                        EXPECT_TRUE (sameMatrices (C2, C_ref));
+
+                        // The checkpoint of other operands or of another grid is rejected
+                        SquareMatrix<float> A2 (A);
+                        A2.setElement (3, 4, A2.element (3, 4) * 2);
+                        EXPECT_EQ (resumeCheckpointed (multiplier, A2, B, C2, NBBLOCKSPERROW, path, std::chrono::milliseconds (0)), -1);
+                        EXPECT_EQ (resumeCheckpointed (multiplier, A, B, C2, 4, path, std::chrono::milliseconds (0)), -1);
+
+                        // A new product overwrites the file
+                        SquareMatrix<float> C3 (MATRIXSIZE);
+                        EXPECT_TRUE (multiplyWithCheckpoint (multiplier, A, B, C3, NBBLOCKSPERROW, path, std::chrono::milliseconds (10)));
+                        EXPECT_TRUE (sameMatrices (C3, C_ref));
+                        std::remove (path.c_str ());
+
+#ifdef CHECK_DURATION
+                      }))
+#endif // CHECK_DURATION
+}
+
 int
 main (int argc, char **argv)
 {